@@ -0,0 +1,198 @@
+#include "ApiMetrics.h"
+
+size_t ApiMetrics::routeOf(crow::HTTPMethod method, std::string_view path) {
+    // Crow accepts a trailing slash, so ignore it here too
+    if (path.size() > 1 && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+
+    // Compare segment by segment against each template
+    auto matches = [path](std::string_view pattern) {
+        size_t pathPos = 0;
+        size_t patternPos = 0;
+        while (pathPos < path.size() && patternPos < pattern.size()) {
+            size_t pathEnd = path.find('/', pathPos + 1);
+            size_t patternEnd = pattern.find('/', patternPos + 1);
+            if (pathEnd == std::string_view::npos) pathEnd = path.size();
+            if (patternEnd == std::string_view::npos) patternEnd = pattern.size();
+
+            std::string_view segment = path.substr(pathPos, pathEnd - pathPos);
+            std::string_view expected = pattern.substr(patternPos, patternEnd - patternPos);
+            if (expected == "/<int>") {
+                if (segment.size() < 2 || segment.find_first_not_of("-0123456789", 1) != std::string_view::npos) {
+                    return false;
+                }
+            }
+            else if (expected == "/<uint>") {
+                if (segment.size() < 2 || segment.find_first_not_of("0123456789", 1) != std::string_view::npos) {
+                    return false;
+                }
+            }
+            else if (expected == "/<string>") {
+                if (segment.size() < 2) {
+                    return false;
+                }
+            }
+            else if (segment != expected) {
+                return false;
+            }
+
+            pathPos = pathEnd;
+            patternPos = patternEnd;
+        }
+        return pathPos == path.size() && patternPos == pattern.size();
+    };
+
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        if (ROUTES[i].method == method && matches(ROUTES[i].path)) {
+            return i;
+        }
+    }
+    return OTHER_ROUTE;
+}
+
+void ApiMetrics::recordRequest(size_t route, int status, std::chrono::nanoseconds elapsed) {
+    size_t statusIndex = STATUS_COUNT;
+    for (size_t i = 0; i < STATUS_COUNT; i++) {
+        if (STATUS_CODES[i] == status) {
+            statusIndex = i;
+            break;
+        }
+    }
+    requests[route < ROUTE_COUNT ? route : OTHER_ROUTE][statusIndex].observe(elapsed);
+}
+
+void ApiMetrics::recordRender(Body body, std::chrono::nanoseconds elapsed) {
+    renders[static_cast<size_t>(body)].observe(elapsed);
+}
+
+void ApiMetrics::requestStarted() {
+    inFlight++;
+}
+
+void ApiMetrics::requestFinished() {
+    // waitForIdle sets draining before checking the count under idleMutex, so either it
+    // sees zero or this notify reaches it
+    if (--inFlight == 0 && draining) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idle.notify_all();
+    }
+}
+
+size_t ApiMetrics::requestsInFlight() const {
+    return inFlight;
+}
+
+bool ApiMetrics::waitForIdle(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(idleMutex);
+    draining = true;
+    bool drained = idle.wait_for(lock, timeout, [this]() { return inFlight == 0; });
+    draining = false;
+    return drained;
+}
+
+std::string ApiMetrics::render(const KeyManager& keyManager, const ResponseCache& responseCache) const {
+    std::string out;
+    out.reserve(64 * 1024);
+
+    // Only series that have seen a request are listed
+    auto requestLabels = [](size_t route, size_t status) {
+        std::string labels = "method=\"";
+        labels += route < ROUTE_COUNT ? ROUTES[route].methodName : "other";
+        labels += "\",route=\"";
+        labels += route < ROUTE_COUNT ? ROUTES[route].path : "other";
+        labels += "\",code=\"";
+        labels += status < STATUS_COUNT ? std::to_string(STATUS_CODES[status]) : "other";
+        labels += '"';
+        return labels;
+    };
+
+    Prometheus::appendHeader(out, "kms_http_requests_total", "counter", "Requests handled, by route and status code.");
+    for (size_t route = 0; route <= ROUTE_COUNT; route++) {
+        for (size_t status = 0; status <= STATUS_COUNT; status++) {
+            if (requests[route][status].count() > 0) {
+                Prometheus::appendSample(out, "kms_http_requests_total", requestLabels(route, status),
+                    requests[route][status].count());
+            }
+        }
+    }
+
+    Prometheus::appendHeader(out, "kms_http_request_duration_seconds", "histogram",
+        "Time spent in the request handler, by route and status code.");
+    for (size_t route = 0; route <= ROUTE_COUNT; route++) {
+        for (size_t status = 0; status <= STATUS_COUNT; status++) {
+            if (requests[route][status].count() > 0) {
+                requests[route][status].appendPrometheus(out, "kms_http_request_duration_seconds",
+                    requestLabels(route, status));
+            }
+        }
+    }
+
+    Prometheus::appendHeader(out, "kms_http_requests_in_flight", "gauge", "Requests being handled, this one included.");
+    Prometheus::appendSample(out, "kms_http_requests_in_flight", "", static_cast<uint64_t>(requestsInFlight()));
+
+    static const char* bodyNames[] = { "keyList", "userKeys", "stats" };
+    Prometheus::appendHeader(out, "kms_json_render_seconds", "histogram", "Time spent building JSON response bodies.");
+    for (size_t body = 0; body < static_cast<size_t>(Body::Count); body++) {
+        renders[body].appendPrometheus(out, "kms_json_render_seconds", std::string("body=\"") + bodyNames[body] + "\"");
+    }
+
+    Prometheus::appendHeader(out, "kms_response_cache_lookups_total", "counter",
+        "Lookups of cached response bodies, by body, content coding and result.");
+    static const char* encodingNames[] = { "identity", "gzip", "deflate" };
+    for (size_t slot = 0; slot < static_cast<size_t>(ResponseCache::Slot::Count); slot++) {
+        auto cacheSlot = static_cast<ResponseCache::Slot>(slot);
+        for (size_t coding = 0; coding < static_cast<size_t>(ContentEncoding::Count); coding++) {
+            auto encoding = static_cast<ContentEncoding>(coding);
+            std::string labels = std::string("body=\"") + ResponseCache::slotName(cacheSlot) +
+                "\",encoding=\"" + encodingNames[coding] + "\",result=";
+            Prometheus::appendSample(out, "kms_response_cache_lookups_total", labels + "\"hit\"",
+                responseCache.hits(cacheSlot, encoding));
+            Prometheus::appendSample(out, "kms_response_cache_lookups_total", labels + "\"miss\"",
+                responseCache.misses(cacheSlot, encoding));
+        }
+    }
+
+    Prometheus::appendHeader(out, "kms_response_cache_bytes", "gauge", "Bytes held by cached response bodies.");
+    Prometheus::appendSample(out, "kms_response_cache_bytes", "", static_cast<uint64_t>(responseCache.memoryUsage()));
+
+    const KeyManagerMetrics& managerMetrics = keyManager.getMetrics();
+    Prometheus::appendHeader(out, "kms_lock_wait_seconds", "histogram",
+        "Time spent waiting for the key collection lock, by mode.");
+    managerMetrics.readLockWait.appendPrometheus(out, "kms_lock_wait_seconds", "mode=\"shared\"");
+    managerMetrics.writeLockWait.appendPrometheus(out, "kms_lock_wait_seconds", "mode=\"exclusive\"");
+
+    Prometheus::appendHeader(out, "kms_save_duration_seconds", "histogram",
+        "Time spent in saveKeys: capturing a flat copy of the keys under shared locks and handing it to the storage.");
+    managerMetrics.saveDuration.appendPrometheus(out, "kms_save_duration_seconds", "");
+
+    Prometheus::appendHeader(out, "kms_snapshot_written_bytes_total", "counter",
+        "Bytes written to the database snapshot, checkpoints included.");
+    Prometheus::appendSample(out, "kms_snapshot_written_bytes_total", "", keyManager.getSnapshotBytesWritten());
+
+    KeyStats stats = keyManager.getStats();
+    Prometheus::appendHeader(out, "kms_keys", "gauge", "Keys in the collection, by type and state.");
+    for (size_t i = 0; i < KeyStats::TYPE_COUNT; i++) {
+        KeyType type = static_cast<KeyType>(i);
+        std::string typeLabel = "type=\"" + std::string(Key::typeName(type)) + "\",state=";
+        Prometheus::appendSample(out, "kms_keys", typeLabel + "\"used\"", static_cast<uint64_t>(stats.usedOf(type)));
+        Prometheus::appendSample(out, "kms_keys", typeLabel + "\"available\"", static_cast<uint64_t>(stats.availableOf(type)));
+    }
+
+    return out;
+}
+
+void RequestMetrics::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    ctx.start = std::chrono::steady_clock::now();
+    if (metrics) {
+        metrics->requestStarted();
+    }
+}
+
+void RequestMetrics::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (metrics) {
+        metrics->recordRequest(ApiMetrics::routeOf(req.method, req.url), res.code,
+            std::chrono::steady_clock::now() - ctx.start);
+        metrics->requestFinished();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef API_METRICS_H
+#define API_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "KeyManager.h"
+#include "Metrics.h"
+#include "ResponseCache.h"
+// Configure Crow to use Boost.ASIO
+#define CROW_USE_BOOST_ASIO
+#include <crow.h>
+
+// Request counters and latencies of the API server, rendered by /metrics.
+// Requests are attributed to the route template they matched (so /api/keys/17/use
+// and /api/keys/18/use share a series) and their status code. All counters are
+// atomics in fixed tables, so recording a request takes no lock.
+class ApiMetrics {
+public:
+    struct Route {
+        crow::HTTPMethod method;
+        const char* methodName;
+        const char* path;  // Segments "<int>" and "<string>" match any value
+    };
+
+    // Every route registered in ApiServer::setupRoutes; anything else counts as "other"
+    static constexpr Route ROUTES[] = {
+        { crow::HTTPMethod::Get, "GET", "/health" },
+        { crow::HTTPMethod::Get, "GET", "/version" },
+        { crow::HTTPMethod::Get, "GET", "/metrics" },
+        { crow::HTTPMethod::Get, "GET", "/api/keys" },
+        { crow::HTTPMethod::Get, "GET", "/api/keys/type/<int>" },
+        { crow::HTTPMethod::Post, "POST", "/api/keys" },
+        { crow::HTTPMethod::Post, "POST", "/api/keys/claim" },
+        { crow::HTTPMethod::Post, "POST", "/api/keys/batch" },
+        { crow::HTTPMethod::Put, "PUT", "/api/keys/<uint>/use" },
+        { crow::HTTPMethod::Put, "PUT", "/api/keys/<uint>/unuse" },
+        { crow::HTTPMethod::Get, "GET", "/api/keys/value/<string>" },
+        { crow::HTTPMethod::Put, "PUT", "/api/keys/value/<string>/use" },
+        { crow::HTTPMethod::Put, "PUT", "/api/keys/value/<string>/unuse" },
+        { crow::HTTPMethod::Get, "GET", "/api/users/<string>/keys" },
+        { crow::HTTPMethod::Get, "GET", "/api/changes" },
+        { crow::HTTPMethod::Get, "GET", "/api/stats" },
+        { crow::HTTPMethod::Get, "GET", "/api/stats/persistence" },
+    };
+    static constexpr size_t ROUTE_COUNT = sizeof(ROUTES) / sizeof(ROUTES[0]);
+    static constexpr size_t OTHER_ROUTE = ROUTE_COUNT;
+
+    // Status codes the routes return; anything else counts as "other"
+    static constexpr int STATUS_CODES[] = { 200, 201, 304, 400, 401, 404, 405, 409, 413, 429, 500, 503 };
+    static constexpr size_t STATUS_COUNT = sizeof(STATUS_CODES) / sizeof(STATUS_CODES[0]);
+
+    // Response bodies whose rendering is timed separately
+    enum class Body { KeyList, UserKeys, Stats, Count };
+
+    // Index into ROUTES for a request, or OTHER_ROUTE
+    static size_t routeOf(crow::HTTPMethod method, std::string_view path);
+
+    void recordRequest(size_t route, int status, std::chrono::nanoseconds elapsed);
+    void recordRender(Body body, std::chrono::nanoseconds elapsed);
+
+    // Requests between the middleware's before_handle and after_handle. Only the
+    // last request to finish while a waitForIdle is pending touches the mutex.
+    void requestStarted();
+    void requestFinished();
+    size_t requestsInFlight() const;
+
+    // Block until no request is in flight; false if timeout passed first
+    bool waitForIdle(std::chrono::milliseconds timeout);
+
+    // The whole exposition: request series, JSON rendering, response cache lookups,
+    // keysMutex waits, saves and the key counts per type
+    std::string render(const KeyManager& keyManager, const ResponseCache& responseCache) const;
+
+private:
+    LatencyHistogram requests[ROUTE_COUNT + 1][STATUS_COUNT + 1];
+    LatencyHistogram renders[static_cast<size_t>(Body::Count)];
+
+    std::atomic<size_t> inFlight{ 0 };
+    std::atomic<bool> draining{ false };
+    std::mutex idleMutex;
+    std::condition_variable idle;
+};
+
+// Crow middleware timing every request into an ApiMetrics
+struct RequestMetrics {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    ApiMetrics* metrics = nullptr;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+};
+
+#endif // API_METRICS_H
\ No newline at end of file
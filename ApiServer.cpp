@@ -1,22 +1,250 @@
 #include "ApiServer.h"
+#include "HttpCompression.h"
+#include "JsonRenderer.h"
 #include "Key.h"
+#include "KeyImporter.h"
 #include <iostream>
 #include <sstream>
-#include <mutex>
-#include <map>
+#include <stdexcept>
 #include <fstream>
 #include <thread>
 #include <chrono>
-
-// Thread safety for concurrent API requests
-std::mutex apiMutex;
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <future>
 
 // API key for authentication
 const std::string API_KEY = "your-secret-api-key";
 
+// Minimal JSON field extraction for request bodies, matching the manual parsing used by the routes
+static bool extractJsonString(const std::string& body, const std::string& field, std::string& value) {
+    size_t pos = body.find("\"" + field + "\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    pos = body.find(':', pos + field.size() + 2);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos++;
+    while (pos < body.size() && (body[pos] == ' ' || body[pos] == '\t')) pos++;
+
+    if (pos >= body.size() || body[pos] != '"') {
+        return false;
+    }
+    pos++;
+
+    size_t end = body.find('"', pos);
+    if (end == std::string::npos) {
+        return false;
+    }
+
+    value = body.substr(pos, end - pos);
+    return true;
+}
+
+// Decode %XX escapes in a path segment; '+' is literal in paths
+static std::string decodeUrlComponent(const std::string& encoded) {
+    auto hexValue = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    std::string decoded;
+    decoded.reserve(encoded.size());
+    for (size_t i = 0; i < encoded.size(); i++) {
+        int high, low;
+        if (encoded[i] == '%' && i + 2 < encoded.size() &&
+            (high = hexValue(encoded[i + 1])) >= 0 && (low = hexValue(encoded[i + 2])) >= 0) {
+            decoded += static_cast<char>(high * 16 + low);
+            i += 2;
+        }
+        else {
+            decoded += encoded[i];
+        }
+    }
+    return decoded;
+}
+
+static bool extractJsonInt(const std::string& body, const std::string& field, int& value) {
+    size_t pos = body.find("\"" + field + "\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    pos = body.find(':', pos + field.size() + 2);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos++;
+    while (pos < body.size() && (body[pos] == ' ' || body[pos] == '\t')) pos++;
+
+    if (pos >= body.size() || !std::isdigit(static_cast<unsigned char>(body[pos]))) {
+        return false;
+    }
+
+    value = 0;
+    while (pos < body.size() && std::isdigit(static_cast<unsigned char>(body[pos])) && value < 100000) {
+        value = value * 10 + (body[pos] - '0');
+        pos++;
+    }
+    return true;
+}
+
+// Parse a whole query parameter as an unsigned number. Signs, whitespace, trailing characters
+// and values past 64 bits are all rejected, where std::stoull would wrap "-1" or read "10abc" as 10.
+static bool parseUnsignedParam(const char* text, uint64_t& value) {
+    const char* end = text + std::strlen(text);
+    auto [parsed, error] = std::from_chars(text, end, value);
+    return error == std::errc() && parsed == end && parsed != text;
+}
+
+// Split the array in a body field into the text of its objects, skipping over braces inside strings
+static bool extractJsonObjects(const std::string& body, const std::string& field, std::vector<std::string>& objects) {
+    size_t pos = body.find("\"" + field + "\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    pos = body.find(':', pos + field.size() + 2);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos++;
+    while (pos < body.size() && std::isspace(static_cast<unsigned char>(body[pos]))) pos++;
+
+    if (pos >= body.size() || body[pos] != '[') {
+        return false;
+    }
+    pos++;
+
+    size_t depth = 0;
+    size_t objectStart = 0;
+    bool inString = false;
+    for (; pos < body.size(); pos++) {
+        char c = body[pos];
+        if (inString) {
+            if (c == '\\') {
+                pos++;
+            }
+            else if (c == '"') {
+                inString = false;
+            }
+        }
+        else if (c == '"') {
+            inString = true;
+        }
+        else if (c == '{') {
+            if (depth++ == 0) {
+                objectStart = pos;
+            }
+        }
+        else if (c == '}') {
+            if (depth == 0) {
+                return false;
+            }
+            if (--depth == 0) {
+                objects.push_back(body.substr(objectStart, pos - objectStart + 1));
+            }
+        }
+        else if (c == ']' && depth == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read one batch operation, or describe what is wrong with it
+static bool parseBatchOperation(const std::string& object, BatchOperation& operation, std::string& error) {
+    std::string kind;
+    if (!extractJsonString(object, "op", kind)) {
+        error = "Missing or invalid 'op' parameter";
+        return false;
+    }
+    if (!extractJsonString(object, "value", operation.value) || operation.value.empty()) {
+        error = "Missing or invalid 'value' parameter";
+        return false;
+    }
+
+    if (kind == "add") {
+        int keyTypeInt;
+        if (!extractJsonInt(object, "type", keyTypeInt) || keyTypeInt > 3) {
+            error = "Missing or invalid 'type' parameter. Must be 0-3";
+            return false;
+        }
+        // Added keys are written to the database, so they get the same checks as imported ones
+        if (!KeyImporter::isValidKey(operation.value)) {
+            error = "Invalid key value";
+            return false;
+        }
+        operation.kind = BatchOperation::Kind::Add;
+        operation.type = static_cast<KeyType>(keyTypeInt);
+    }
+    else if (kind == "use") {
+        if (!extractJsonString(object, "discordUsername", operation.discordUsername) ||
+            !KeyImporter::isValidUsername(operation.discordUsername)) {
+            error = "Missing or invalid 'discordUsername' parameter";
+            return false;
+        }
+        operation.kind = BatchOperation::Kind::Use;
+    }
+    else if (kind == "unuse") {
+        operation.kind = BatchOperation::Kind::Unuse;
+    }
+    else {
+        error = "'op' must be 'add', 'use' or 'unuse'";
+        return false;
+    }
+    return true;
+}
+
+// Whether an If-None-Match header lists the ETag (or is "*"); weak validators compare equal
+static bool matchesETag(const std::string& ifNoneMatch, const std::string& etag) {
+    size_t pos = 0;
+    while (pos < ifNoneMatch.size()) {
+        size_t end = ifNoneMatch.find(',', pos);
+        if (end == std::string::npos) {
+            end = ifNoneMatch.size();
+        }
+
+        size_t first = ifNoneMatch.find_first_not_of(" \t", pos);
+        size_t last = ifNoneMatch.find_last_not_of(" \t", end - 1);
+        if (first != std::string::npos && first < end && last >= first) {
+            std::string_view candidate(ifNoneMatch.data() + first, last - first + 1);
+            if (candidate.substr(0, 2) == "W/") {
+                candidate.remove_prefix(2);
+            }
+            if (candidate == "*" || candidate == etag) {
+                return true;
+            }
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// 304 for a conditional GET whose ETag still matches
+static crow::response notModified(const std::string& etag) {
+    crow::response response(304);
+    response.set_header("ETag", etag);
+    return response;
+}
+
 ApiServer::ApiServer() :
     keyManager(std::make_unique<KeyManager>()),
+    compressionMinBytes(HttpCompression::DEFAULT_MIN_BYTES),
+    etagEpoch(static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())),
     running(false),
+    failed(false),
+    stopRequested(false),
+    workerCount(0),
+    changeWaiters(0),
+    maxChangeWaiters(1),
+    idleTimeoutSeconds(5),
     port(8080),
     useHttps(false),
     certFile("server.crt"),
@@ -48,36 +276,75 @@ void ApiServer::start(int serverPort, bool withHttps, const std::string& sslCert
     }
 
     // Start server thread
+    stopRequested = false;
+    failed = false;
+    keyManager->getChangeFeed().reopen();
     running = true;
     serverThread = std::thread(&ApiServer::runServer, this);
 
     std::cout << "API server started on " << (useHttps ? "https" : "http") << "://localhost:" << port << std::endl;
 }
 
+void ApiServer::requestStop() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopRequested = true;
+    }
+    stateChanged.notify_all();
+}
+
+bool ApiServer::waitForStopRequest(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    return stateChanged.wait_for(lock, timeout, [this]() { return stopRequested.load(); });
+}
+
 void ApiServer::stop() {
     if (!isRunning()) {
         return;
     }
 
     std::cout << "Stopping API server..." << std::endl;
-    running = false;
+    requestStop();
 
-    // Clean up server thread
+    // Long-polls of /api/changes return now instead of holding their workers until they time out.
+    // The feed stays closed, so one that passed the stopRequested check just before still does not wait.
+    keyManager->getChangeFeed().close();
+
+    // The server thread drains, stops Crow and flushes persistence
     if (serverThread.joinable()) {
         serverThread.join();
     }
+    running = false;
 
     std::cout << "API server stopped" << std::endl;
 }
 
+void ApiServer::configureServer(unsigned workers, unsigned idleTimeout) {
+    workerCount = workers;
+    idleTimeoutSeconds = std::clamp(idleTimeout, 1u, 255u);
+}
+
+void ApiServer::configurePersistence(std::chrono::microseconds commitWindow, size_t maxBatchSize) {
+    keyManager->configurePersistence(commitWindow, maxBatchSize);
+}
+
+void ApiServer::configureCompression(size_t minBytes) {
+    compressionMinBytes = minBytes;
+}
+
 bool ApiServer::isRunning() const {
     return running;
 }
 
+bool ApiServer::hasFailed() const {
+    return failed;
+}
+
 void ApiServer::runServer() {
     try {
         // Create a Crow app
-        crow::SimpleApp app;
+        ApiApp app;
+        app.get_middleware<RequestMetrics>().metrics = &metrics;
 
         // Setup routes
         setupRoutes(app);
@@ -88,26 +355,50 @@ void ApiServer::runServer() {
         // Configure app to listen on specified port
         app.port(port);
 
-        // Start in non-blocking mode to allow graceful shutdown
-        app.run_async();
-
-        // Keep server running until stopped
-        while (running) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+        // Every long-poll of /api/changes holds a worker, so size the pool for the hardware and
+        // leave at least half of it to the other routes
+        unsigned workers = std::min(workerCount ? workerCount : std::max(std::thread::hardware_concurrency(), 2u), 1024u);
+        app.concurrency(static_cast<uint16_t>(workers));
+        app.timeout(static_cast<uint8_t>(idleTimeoutSeconds));
+        maxChangeWaiters = std::max(workers / 2, 1u);
+        std::cout << "Using " << workers << " worker threads, up to " << maxChangeWaiters
+            << " of them for waiting /api/changes requests." << std::endl;
+
+        // Start in non-blocking mode; the future waits for the server to finish when destroyed
+        auto server = app.run_async();
+
+        // Sleep until stop is requested. Crow's run() ends at once when it cannot listen
+        // (e.g. the port is taken), so watch the future too rather than waiting forever.
+        while (!waitForStopRequest(std::chrono::milliseconds(100))) {
+            if (server.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                server.get();  // Rethrows the bind error, if Crow threw one
+                throw std::runtime_error("Web server exited without being stopped");
+            }
         }
 
-        // Shut down the server
+        // Let the requests in flight finish before Crow drops their connections
+        if (!metrics.waitForIdle(DRAIN_TIMEOUT)) {
+            std::cerr << "Warning: " << metrics.requestsInFlight() << " requests still running at shutdown" << std::endl;
+        }
         app.stop();
+
+        if (!keyManager->flush()) {
+            std::cerr << "Error: Failed to write pending key changes to the journal." << std::endl;
+        }
     }
     catch (const std::exception& e) {
         std::cerr << "Error in server thread: " << e.what() << std::endl;
+        failed = true;
+        requestStop();
     }
     catch (...) {
         std::cerr << "Unknown error in server thread" << std::endl;
+        failed = true;
+        requestStop();
     }
 }
 
-void ApiServer::setupRoutes(crow::SimpleApp& app) {
+void ApiServer::setupRoutes(ApiApp& app) {
     // Health check endpoint (no authentication required)
     CROW_ROUTE(app, "/health")
         ([]() {
@@ -125,6 +416,19 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
         return crow::response(200, json);
             });
 
+    // Prometheus metrics (no authentication required, like /health, so scrapers need no API key)
+    CROW_ROUTE(app, "/metrics")
+        ([this]() {
+        try {
+            crow::response response(200, metrics.render(*keyManager, responseCache));
+            response.set_header("Content-Type", "text/plain; version=0.0.4");
+            return response;
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, std::string("Error rendering metrics: ") + e.what());
+        }
+            });
+
     // Authentication middleware function
     auto authenticateRequest = [](const crow::request& req) -> bool {
         auto apiKey = req.get_header_value("X-API-Key");
@@ -139,31 +443,7 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
             return crow::response(401, R"({"error":"Unauthorized"})");
         }
 
-        try {
-            std::lock_guard<std::mutex> lock(apiMutex);
-            auto keys = getAllKeys();
-
-            std::stringstream json;
-            json << R"({"keys":[)";
-
-            for (size_t i = 0; i < keys.size(); i++) {
-                if (i > 0) json << ",";
-                json << R"({)";
-                json << R"("id":)" << i << R"(,)";
-                json << R"("value":")" << keys[i].getKeyValue() << R"(",)";
-                json << R"("type":)" << static_cast<int>(keys[i].getKeyType()) << R"(,)";
-                json << R"("typeName":")" << keys[i].getKeyTypeName() << R"(",)";
-                json << R"("used":)" << (keys[i].getIsUsed() ? "true" : "false") << R"(,)";
-                json << R"("discordUsername":")" << keys[i].getDiscordUsername() << R"(")";
-                json << R"(})";
-            }
-
-            json << R"(]})";
-            return crow::response(200, json.str());
-        }
-        catch (const std::exception& e) {
-            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
-        }
+        return renderKeyList(req, std::nullopt);
             });
 
     // Get keys by type
@@ -174,48 +454,12 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
             return crow::response(401, R"({"error":"Unauthorized"})");
         }
 
-        try {
-            std::lock_guard<std::mutex> lock(apiMutex);
-
-            // Validate type parameter
-            if (typeInt < 0 || typeInt > 3) {
-                return crow::response(400, R"({"error":"Invalid key type. Must be 0-3"})");
-            }
-
-            KeyType keyType = static_cast<KeyType>(typeInt);
-
-            // Filter keys by type
-            auto allKeys = getAllKeys();
-            std::vector<Key> filteredKeys;
-
-            for (const auto& key : allKeys) {
-                if (key.getKeyType() == keyType) {
-                    filteredKeys.push_back(key);
-                }
-            }
-
-            // Build response
-            std::stringstream json;
-            json << R"({"keys":[)";
-
-            for (size_t i = 0; i < filteredKeys.size(); i++) {
-                if (i > 0) json << ",";
-                json << R"({)";
-                json << R"("id":)" << i << R"(,)";
-                json << R"("value":")" << filteredKeys[i].getKeyValue() << R"(",)";
-                json << R"("type":)" << static_cast<int>(filteredKeys[i].getKeyType()) << R"(,)";
-                json << R"("typeName":")" << filteredKeys[i].getKeyTypeName() << R"(",)";
-                json << R"("used":)" << (filteredKeys[i].getIsUsed() ? "true" : "false") << R"(,)";
-                json << R"("discordUsername":")" << filteredKeys[i].getDiscordUsername() << R"(")";
-                json << R"(})";
-            }
-
-            json << R"(]})";
-            return crow::response(200, json.str());
-        }
-        catch (const std::exception& e) {
-            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        // Validate type parameter
+        if (typeInt < 0 || typeInt > 3) {
+            return crow::response(400, R"({"error":"Invalid key type. Must be 0-3"})");
         }
+
+        return renderKeyList(req, static_cast<KeyType>(typeInt));
             });
 
     // Create a new key
@@ -257,6 +501,11 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
                 return crow::response(400, R"({"error":"'value' cannot be empty"})");
             }
 
+            // Added keys are written to the database, so they get the same checks as imported ones
+            if (!KeyImporter::isValidKey(keyValue)) {
+                return crow::response(400, R"({"error":"Invalid key value"})");
+            }
+
             // Extract key type
             size_t typePos = body.find("\"type\"");
             if (typePos == std::string::npos) {
@@ -278,7 +527,6 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
             }
 
             // Add the key
-            std::lock_guard<std::mutex> lock(apiMutex);
             if (addKey(keyValue, static_cast<KeyType>(keyTypeInt))) {
                 return crow::response(201, R"({"status":"success"})");
             }
@@ -291,10 +539,72 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
         }
             });
 
+    // Claim the next available key of a type for a user
+    CROW_ROUTE(app, "/api/keys/claim")
+        .methods("POST"_method)
+        ([this, authenticateRequest](const crow::request& req) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            int keyTypeInt;
+            if (!extractJsonInt(req.body, "type", keyTypeInt)) {
+                return crow::response(400, R"({"error":"Missing or invalid 'type' parameter"})");
+            }
+            if (keyTypeInt < 0 || keyTypeInt > 3) {
+                return crow::response(400, R"({"error":"Invalid key type. Must be 0-3"})");
+            }
+
+            std::string discordUsername;
+            if (!extractJsonString(req.body, "discordUsername", discordUsername) ||
+                !KeyImporter::isValidUsername(discordUsername)) {
+                return crow::response(400, R"({"error":"Missing or invalid 'discordUsername' parameter"})");
+            }
+
+            // KeyManager picks and marks the key under its write lock, so two claims never get the same key
+            auto claimed = claimKey(static_cast<KeyType>(keyTypeInt), discordUsername);
+            if (!claimed) {
+                return crow::response(404, R"({"error":"No available keys of this type"})");
+            }
+
+            std::string json = R"({"status":"success","key":{"value":")";
+            JsonRenderer::appendEscaped(json, claimed->getKeyValue());
+            json += R"(","type":)" + std::to_string(static_cast<int>(claimed->getKeyType()));
+            json += R"(,"typeName":")";
+            json += claimed->getKeyTypeName();
+            json += R"(","used":true,"discordUsername":")";
+            JsonRenderer::appendEscaped(json, claimed->getDiscordUsername());
+            json += R"("}})";
+            return crow::response(200, json);
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
+    // Apply many adds, uses and unuses with one lock acquisition and one persist
+    CROW_ROUTE(app, "/api/keys/batch")
+        .methods("POST"_method)
+        ([this, authenticateRequest](const crow::request& req) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            return applyBatch(req);
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
     // Mark key as used
-    CROW_ROUTE(app, "/api/keys/<int>/use")
+    CROW_ROUTE(app, "/api/keys/<uint>/use")
         .methods("PUT"_method)
-        ([this, authenticateRequest](const crow::request& req, int keyId) {
+        ([this, authenticateRequest](const crow::request& req, uint64_t keyId) {
         // Check authentication
         if (!authenticateRequest(req)) {
             return crow::response(401, R"({"error":"Unauthorized"})");
@@ -326,9 +636,11 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
             }
 
             std::string discordUsername = body.substr(usernamePos, usernameEnd - usernamePos);
+            if (!KeyImporter::isValidUsername(discordUsername)) {
+                return crow::response(400, R"({"error":"Invalid 'discordUsername' parameter"})");
+            }
 
             // Mark key as used
-            std::lock_guard<std::mutex> lock(apiMutex);
             if (markKeyAsUsed(keyId, discordUsername)) {
                 return crow::response(200, R"({"status":"success"})");
             }
@@ -342,9 +654,9 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
             });
 
     // Mark key as unused
-    CROW_ROUTE(app, "/api/keys/<int>/unuse")
+    CROW_ROUTE(app, "/api/keys/<uint>/unuse")
         .methods("PUT"_method)
-        ([this, authenticateRequest](const crow::request& req, int keyId) {
+        ([this, authenticateRequest](const crow::request& req, uint64_t keyId) {
         // Check authentication
         if (!authenticateRequest(req)) {
             return crow::response(401, R"({"error":"Unauthorized"})");
@@ -352,7 +664,6 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
 
         try {
             // Mark key as unused
-            std::lock_guard<std::mutex> lock(apiMutex);
             if (markKeyAsUnused(keyId)) {
                 return crow::response(200, R"({"status":"success"})");
             }
@@ -365,6 +676,102 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
         }
             });
 
+    // Look up one key by its value (percent-encoded in the path)
+    CROW_ROUTE(app, "/api/keys/value/<string>")
+        ([this, authenticateRequest](const crow::request& req, const std::string& encodedValue) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            auto found = keyManager->findKey(decodeUrlComponent(encodedValue));
+            if (!found) {
+                return crow::response(404, R"({"error":"Key not found"})");
+            }
+
+            std::string json;
+            JsonRenderer::appendKey(json, found->first, found->second);
+            return crow::response(200, json);
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
+    // Mark a key as used by its value
+    CROW_ROUTE(app, "/api/keys/value/<string>/use")
+        .methods("PUT"_method)
+        ([this, authenticateRequest](const crow::request& req, const std::string& encodedValue) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            std::string discordUsername;
+            if (!extractJsonString(req.body, "discordUsername", discordUsername) ||
+                !KeyImporter::isValidUsername(discordUsername)) {
+                return crow::response(400, R"({"error":"Missing or invalid 'discordUsername' parameter"})");
+            }
+
+            if (keyManager->markKeyByValue(decodeUrlComponent(encodedValue), discordUsername)) {
+                return crow::response(200, R"({"status":"success"})");
+            }
+            return crow::response(404, R"({"error":"Key not found"})");
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
+    // Mark a key as unused by its value
+    CROW_ROUTE(app, "/api/keys/value/<string>/unuse")
+        .methods("PUT"_method)
+        ([this, authenticateRequest](const crow::request& req, const std::string& encodedValue) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            if (keyManager->markKeyAsUnusedByValue(decodeUrlComponent(encodedValue))) {
+                return crow::response(200, R"({"status":"success"})");
+            }
+            return crow::response(404, R"({"error":"Key not found or already unused"})");
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
+    // Get the keys held by a Discord username (?match=substring for every username containing it)
+    CROW_ROUTE(app, "/api/users/<string>/keys")
+        ([this, authenticateRequest](const crow::request& req, const std::string& encodedUsername) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            std::string username = decodeUrlComponent(encodedUsername);
+            const char* match = req.url_params.get("match");
+            bool substring = match && std::string(match) == "substring";
+            if (match && !substring && std::string(match) != "exact") {
+                return crow::response(400, R"({"error":"'match' must be 'exact' or 'substring'"})");
+            }
+
+            auto renderStart = std::chrono::steady_clock::now();
+            std::string body = JsonRenderer::renderUserKeys(*keyManager, username, substring);
+            metrics.recordRender(ApiMetrics::Body::UserKeys, std::chrono::steady_clock::now() - renderStart);
+
+            return crow::response(200, body);
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
+
     // Get key statistics
     CROW_ROUTE(app, "/api/stats")
         ([this, authenticateRequest](const crow::request& req) {
@@ -374,123 +781,389 @@ void ApiServer::setupRoutes(crow::SimpleApp& app) {
         }
 
         try {
-            std::lock_guard<std::mutex> lock(apiMutex);
-            auto statsJsonStr = getStatsJson();
-            return crow::response(200, statsJsonStr);
+            // ?verify=1 recounts every key and reports whether the counters agree, so it is never cached
+            if (req.url_params.get("verify") != nullptr) {
+                auto statsJsonStr = getStatsJson();
+                bool consistent = keyManager->verifyStats();
+                statsJsonStr.pop_back();
+                statsJsonStr += consistent ? R"(,"consistent":true})" : R"(,"consistent":false})";
+                return crow::response(200, statsJsonStr);
+            }
+
+            uint64_t version = keyManager->getVersion();
+            std::string etag = etagOf(version);
+            if (matchesETag(req.get_header_value("If-None-Match"), etag)) {
+                return notModified(etag);
+            }
+
+            ResponseCache::Body body = responseCache.find(ResponseCache::Slot::Stats, version);
+            if (!body) {
+                body = responseCache.store(ResponseCache::Slot::Stats, version, getStatsJson());
+            }
+            return sendBody(req, body, etag, ResponseCache::Slot::Stats, version);
         }
         catch (const std::exception& e) {
             return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
         }
             });
-}
 
-// Implement helper methods that interface with KeyManager
-std::vector<Key> ApiServer::getAllKeys() {
-    return keyManager->getAllKeys();
+    // Changes after a version (?since=), long-polling until one arrives (&timeout= seconds)
+    CROW_ROUTE(app, "/api/changes")
+        ([this, authenticateRequest](const crow::request& req) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        return readChanges(req);
+            });
+
+    // Get journal group commit counters
+    CROW_ROUTE(app, "/api/stats/persistence")
+        ([this, authenticateRequest](const crow::request& req) {
+        // Check authentication
+        if (!authenticateRequest(req)) {
+            return crow::response(401, R"({"error":"Unauthorized"})");
+        }
+
+        try {
+            return crow::response(200, getPersistenceStatsJson());
+        }
+        catch (const std::exception& e) {
+            return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+        }
+            });
 }
 
+// Implement helper methods that interface with KeyManager
 bool ApiServer::addKey(const std::string& value, KeyType type) {
     try {
         // Create a Key object with the specified value and type
         Key key(value, type);
 
         // Use your existing method to add a key
-        keyManager->addKey(key);
-        return true;
+        return keyManager->addKey(key);
     }
     catch (...) {
         return false;
     }
 }
 
-bool ApiServer::markKeyAsUsed(int keyId, const std::string& discordUsername) {
+bool ApiServer::markKeyAsUsed(uint64_t keyId, const std::string& discordUsername) {
     try {
-        auto keys = keyManager->getAllKeys();
-
-        // Check if key id is valid
-        if (keyId < 0 || keyId >= static_cast<int>(keys.size())) {
-            return false;
-        }
-
-        // Get the key value
-        std::string keyValue = keys[keyId].getKeyValue();
+        // Ids go straight through KeyManager's id table
+        return keyManager->markKeyById(keyId, discordUsername);
+    }
+    catch (...) {
+        return false;
+    }
+}
 
-        // Mark key as used by value
-        return keyManager->markKeyByValue(keyValue, discordUsername);
+bool ApiServer::markKeyAsUnused(uint64_t keyId) {
+    try {
+        return keyManager->markKeyAsUnusedById(keyId);
     }
     catch (...) {
         return false;
     }
 }
 
-bool ApiServer::markKeyAsUnused(int keyId) {
+crow::response ApiServer::renderKeyList(const crow::request& req, std::optional<KeyType> keyType) {
+    const size_t MAX_LIMIT = 10000;
+
     try {
-        auto keys = keyManager->getAllKeys();
+        size_t cursor = 0;
+        std::optional<size_t> limit;
+        const char* cursorParam = req.url_params.get("cursor");
+        const char* limitParam = req.url_params.get("limit");
+
+        uint64_t parsed = 0;
+        if (cursorParam) {
+            if (!parseUnsignedParam(cursorParam, parsed)) {
+                return crow::response(400, R"({"error":"'limit' and 'cursor' must be numbers"})");
+            }
+            cursor = static_cast<size_t>(parsed);
+        }
+        if (limitParam) {
+            if (!parseUnsignedParam(limitParam, parsed)) {
+                return crow::response(400, R"({"error":"'limit' and 'cursor' must be numbers"})");
+            }
+            if (parsed == 0 || parsed > MAX_LIMIT) {
+                return crow::response(400, R"({"error":"'limit' must be between 1 and 10000"})");
+            }
+            limit = static_cast<size_t>(parsed);
+        }
 
-        // Check if key id is valid
-        if (keyId < 0 || keyId >= static_cast<int>(keys.size())) {
-            return false;
+        // The version is read before rendering, so the body is never older than its ETag
+        // (or than the version it is cached under)
+        uint64_t version = keyManager->getVersion();
+        std::string etag = etagOf(version);
+        if (matchesETag(req.get_header_value("If-None-Match"), etag)) {
+            return notModified(etag);
         }
 
-        // Get the key value
-        std::string keyValue = keys[keyId].getKeyValue();
+        bool cacheable = cursor == 0 && !limit;
+        ResponseCache::Slot slot = ResponseCache::keyListSlot(keyType);
+        ResponseCache::Body body = cacheable ? responseCache.find(slot, version) : nullptr;
+        if (!body) {
+            auto renderStart = std::chrono::steady_clock::now();
+            std::string rendered = JsonRenderer::renderKeyList(*keyManager, keyType, cursor, limit);
+            metrics.recordRender(ApiMetrics::Body::KeyList, std::chrono::steady_clock::now() - renderStart);
 
-        // Mark key as unused by value
-        return keyManager->markKeyAsUnusedByValue(keyValue);
+            if (!cacheable) {
+                return sendBody(req, std::make_shared<const std::string>(std::move(rendered)), etag, std::nullopt, version);
+            }
+            body = responseCache.store(slot, version, std::move(rendered));
+        }
+        return sendBody(req, body, etag, slot, version);
     }
-    catch (...) {
-        return false;
+    catch (const std::exception& e) {
+        return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
     }
 }
 
-std::string ApiServer::getStatsJson() {
-    auto keys = getAllKeys();
+crow::response ApiServer::sendBody(const crow::request& req, const ResponseCache::Body& body, const std::string& etag,
+    std::optional<ResponseCache::Slot> slot, uint64_t version) {
+    ContentEncoding encoding = body->size() >= compressionMinBytes ?
+        HttpCompression::negotiate(req.get_header_value("Accept-Encoding")) : ContentEncoding::Identity;
+
+    ResponseCache::Body sent = body;
+    if (encoding != ContentEncoding::Identity) {
+        ResponseCache::Body compressed = slot ? responseCache.find(*slot, version, encoding) : nullptr;
+        if (!compressed) {
+            std::string out;
+            if (HttpCompression::compress(*body, encoding, out)) {
+                compressed = slot ? responseCache.store(*slot, version, std::move(out), encoding) :
+                    std::make_shared<const std::string>(std::move(out));
+            }
+        }
+
+        // Fall back to the plain body if zlib failed
+        if (compressed) {
+            sent = compressed;
+        }
+        else {
+            encoding = ContentEncoding::Identity;
+        }
+    }
+
+    crow::response response(200, *sent);
+    response.set_header("Vary", "Accept-Encoding");
+    if (encoding != ContentEncoding::Identity) {
+        // The compressed bytes differ from the plain ones, so they get the weak form of the
+        // ETag; matchesETag ignores the W/ prefix, so either form revalidates
+        response.set_header("Content-Encoding", HttpCompression::headerValue(encoding));
+        response.set_header("ETag", "W/" + etag);
+    }
+    else {
+        response.set_header("ETag", etag);
+    }
+    return response;
+}
 
-    // Count totals, used, and by type
-    int totalKeys = keys.size();
-    int usedKeys = 0;
+std::string ApiServer::etagOf(uint64_t version) const {
+    return "\"" + std::to_string(etagEpoch) + "-" + std::to_string(version) + "\"";
+}
+
+std::optional<Key> ApiServer::claimKey(KeyType type, const std::string& discordUsername) {
+    return keyManager->claimKey(type, discordUsername);
+}
 
-    std::map<KeyType, int> totalByType;
-    std::map<KeyType, int> usedByType;
+crow::response ApiServer::applyBatch(const crow::request& req) {
+    std::vector<std::string> objects;
+    if (!extractJsonObjects(req.body, "operations", objects)) {
+        return crow::response(400, R"({"error":"Missing or invalid 'operations' array"})");
+    }
+    if (objects.empty()) {
+        return crow::response(400, R"({"error":"'operations' cannot be empty"})");
+    }
+    if (objects.size() > MAX_BATCH_OPERATIONS) {
+        return crow::response(413, R"({"error":"Too many operations. At most )" +
+            std::to_string(MAX_BATCH_OPERATIONS) + R"( per batch"})");
+    }
 
-    for (const auto& key : keys) {
-        if (key.getIsUsed()) {
-            usedKeys++;
-            usedByType[key.getKeyType()]++;
+    // A malformed operation rejects the whole batch before anything is applied
+    std::vector<BatchOperation> operations(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        std::string error;
+        if (!parseBatchOperation(objects[i], operations[i], error)) {
+            return crow::response(400, R"({"error":"Operation )" + std::to_string(i) + ": " + error + R"("})");
         }
-        totalByType[key.getKeyType()]++;
     }
 
-    std::stringstream json;
-    json << R"({)";
-    json << R"("totalKeys":)" << totalKeys << R"(,)";
-    json << R"("usedKeys":)" << usedKeys << R"(,)";
-    json << R"("availableKeys":)" << (totalKeys - usedKeys) << R"(,)";
+    auto outcomes = keyManager->applyBatch(operations);
+
+    size_t applied = std::count(outcomes.begin(), outcomes.end(), BatchOutcome::Applied);
+    std::string json = R"({"applied":)" + std::to_string(applied);
+    json += R"(,"failed":)" + std::to_string(outcomes.size() - applied);
+    json += R"(,"results":[)";
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        if (i > 0) {
+            json += ',';
+        }
+        json += R"({"value":")";
+        JsonRenderer::appendEscaped(json, operations[i].value);
+        json += '"';
+        switch (outcomes[i]) {
+        case BatchOutcome::Applied:
+            json += R"(,"status":"applied"})";
+            break;
+        case BatchOutcome::AlreadyExists:
+            json += R"(,"status":"failed","error":"Key already exists"})";
+            break;
+        case BatchOutcome::NotFound:
+            json += R"(,"status":"failed","error":"Key not found"})";
+            break;
+        case BatchOutcome::AlreadyUnused:
+            json += R"(,"status":"failed","error":"Key already unused"})";
+            break;
+        }
+    }
+    json += "]}";
 
-    json << R"("keysByType":{)";
+    return crow::response(200, json);
+}
+
+crow::response ApiServer::readChanges(const crow::request& req) {
+    const size_t MAX_LIMIT = 10000;
+
+    try {
+        const char* sinceParam = req.url_params.get("since");
+        const char* limitParam = req.url_params.get("limit");
+        const char* timeoutParam = req.url_params.get("timeout");
+        const char* epochParam = req.url_params.get("epoch");
+
+        if (!sinceParam) {
+            return crow::response(400, R"({"error":"Missing 'since' parameter"})");
+        }
+
+        const auto notNumbers = []() {
+            return crow::response(400, R"({"error":"'since', 'limit', 'timeout' and 'epoch' must be numbers"})");
+        };
+
+        uint64_t since = 0;
+        if (!parseUnsignedParam(sinceParam, since)) {
+            return notNumbers();
+        }
+
+        uint64_t limit = 1000;
+        if (limitParam) {
+            if (!parseUnsignedParam(limitParam, limit)) {
+                return notNumbers();
+            }
+            if (limit == 0 || limit > MAX_LIMIT) {
+                return crow::response(400, R"({"error":"'limit' must be between 1 and 10000"})");
+            }
+        }
+
+        uint64_t timeoutSeconds = DEFAULT_CHANGES_TIMEOUT;
+        if (timeoutParam) {
+            if (!parseUnsignedParam(timeoutParam, timeoutSeconds)) {
+                return notNumbers();
+            }
+            if (timeoutSeconds > MAX_CHANGES_TIMEOUT) {
+                return crow::response(400, R"({"error":"'timeout' must be between 0 and 60"})");
+            }
+        }
+        int timeout = static_cast<int>(timeoutSeconds);
+
+        uint64_t epoch = etagEpoch;
+        if (epochParam && !parseUnsignedParam(epochParam, epoch)) {
+            return notNumbers();
+        }
+
+        ChangeFeed& feed = keyManager->getChangeFeed();
+        std::vector<ChangeFeed::Change> changes;
+        ChangeFeed::ReadResult result = ChangeFeed::ReadResult::ResyncRequired;
+
+        // A server shutting down answers at once rather than holding up the drain
+        if (stopRequested) {
+            timeout = 0;
+        }
 
-    bool first = true;
-    for (int i = 0; i <= 3; i++) {
-        KeyType type = static_cast<KeyType>(i);
-        std::string typeName;
+        // Take a waiting slot, or only look for changes when every slot is taken
+        struct WaiterSlot {
+            std::atomic<unsigned>* waiters = nullptr;
+            ~WaiterSlot() {
+                if (waiters) {
+                    (*waiters)--;
+                }
+            }
+        } slot;
+        bool turnedAway = false;
+        if (timeout > 0) {
+            if (changeWaiters.fetch_add(1) < maxChangeWaiters) {
+                slot.waiters = &changeWaiters;
+            }
+            else {
+                changeWaiters--;
+                timeout = 0;
+                turnedAway = true;
+            }
+        }
+
+        // Versions restart with the server, so a version from an earlier run means nothing here
+        if (epoch == etagEpoch) {
+            result = feed.read(since, static_cast<size_t>(limit), std::chrono::seconds(timeout), changes);
+        }
+
+        if (result == ChangeFeed::ReadResult::ResyncRequired) {
+            return crow::response(200, R"({"epoch":)" + std::to_string(etagEpoch) +
+                R"(,"version":)" + std::to_string(feed.latestVersion()) + R"(,"resyncRequired":true})");
+        }
 
-        switch (type) {
-        case KeyType::Day: typeName = "Daily"; break;
-        case KeyType::Week: typeName = "Weekly"; break;
-        case KeyType::Month: typeName = "Monthly"; break;
-        case KeyType::Lifetime: typeName = "Lifetime"; break;
+        if (result == ChangeFeed::ReadResult::Timeout && turnedAway) {
+            crow::response response(429, R"({"error":"Too many waiting change requests"})");
+            response.set_header("Retry-After", std::to_string(CHANGES_RETRY_AFTER));
+            return response;
         }
 
-        if (!first) json << R"(,)";
-        first = false;
+        uint64_t next = changes.empty() ? since : changes.back().version;
+        return crow::response(200, JsonRenderer::renderChanges(etagEpoch, next, changes));
+    }
+    catch (const std::exception& e) {
+        return crow::response(500, R"({"error":"Internal server error: )" + std::string(e.what()) + R"("})");
+    }
+}
 
-        json << R"(")" << typeName << R"(":{)";
-        json << R"("total":)" << totalByType[type] << R"(,)";
-        json << R"("used":)" << usedByType[type] << R"(,)";
-        json << R"("available":)" << (totalByType[type] - usedByType[type]);
-        json << R"(})";
+std::string ApiServer::getStatsJson() {
+    // Counters are maintained by KeyCollection, so no key is copied or scanned
+    auto renderStart = std::chrono::steady_clock::now();
+    std::string json = JsonRenderer::renderStats(keyManager->getStats());
+    metrics.recordRender(ApiMetrics::Body::Stats, std::chrono::steady_clock::now() - renderStart);
+    return json;
+}
+
+std::string ApiServer::getPersistenceStatsJson() {
+    CommitStats stats;
+    if (!keyManager->getCommitStats(stats)) {
+        return R"({"groupCommit":false})";
     }
 
+    std::stringstream json;
+    json << R"({"groupCommit":true,)";
+    json << R"("commitWindowMicros":)" << stats.commitWindowMicros << R"(,)";
+    json << R"("maxBatchSize":)" << stats.maxBatchSize << R"(,)";
+    json << R"("batches":)" << stats.batches << R"(,)";
+    json << R"("records":)" << stats.records << R"(,)";
+    json << R"("failedBatches":)" << stats.failedBatches << R"(,)";
+    json << R"("largestBatch":)" << stats.largestBatch << R"(,)";
+    json << R"("averageBatchSize":)" << (stats.batches ? static_cast<double>(stats.records) / stats.batches : 0.0) << R"(,)";
+    json << R"("averageLatencyMicros":)" << (stats.batches ? stats.totalLatencyMicros / stats.batches : 0) << R"(,)";
+    json << R"("maxLatencyMicros":)" << stats.maxLatencyMicros << R"(,)";
+
+    // Buckets are keyed by their upper bound, "+Inf" for the last one
+    json << R"("batchSizeHistogram":{)";
+    for (size_t i = 0; i < CommitStats::HISTOGRAM_BUCKETS; i++) {
+        if (i > 0) json << R"(,)";
+        if (CommitStats::HISTOGRAM_LIMITS[i] == SIZE_MAX) {
+            json << R"("+Inf":)";
+        }
+        else {
+            json << R"(")" << CommitStats::HISTOGRAM_LIMITS[i] << R"(":)";
+        }
+        json << stats.batchSizeHistogram[i];
+    }
     json << R"(})";
     json << R"(})";
 
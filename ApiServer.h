@@ -1,38 +1,97 @@
 #ifndef API_SERVER_H
 #define API_SERVER_H
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 #include <vector>
 #include "KeyManager.h"
+#include "ApiMetrics.h"
+#include "ResponseCache.h"
 // Configure Crow to use Boost.ASIO
 #define CROW_USE_BOOST_ASIO
 #include <crow.h>
 
+// Crow app with every request timed into the server's ApiMetrics
+using ApiApp = crow::App<RequestMetrics>;
+
 class ApiServer {
 private:
+    // Most operations accepted by one POST /api/keys/batch
+    static constexpr size_t MAX_BATCH_OPERATIONS = 10000;
+
+    // Longest /api/changes long-poll and its default, in seconds
+    static constexpr int MAX_CHANGES_TIMEOUT = 60;
+    static constexpr int DEFAULT_CHANGES_TIMEOUT = 25;
+
+    // Seconds a client turned away from /api/changes is told to wait before retrying
+    static constexpr int CHANGES_RETRY_AFTER = 1;
+
+    // Longest wait for in-flight requests to finish on shutdown
+    static constexpr std::chrono::milliseconds DRAIN_TIMEOUT{ 5000 };
+
     std::unique_ptr<KeyManager> keyManager;
+    ApiMetrics metrics;
+    ResponseCache responseCache;  // Full key lists and stats, by KeyManager version
+    std::atomic<size_t> compressionMinBytes;
+    uint64_t etagEpoch;  // Start time of this server, so ETags from an earlier run never match
     std::thread serverThread;
     std::atomic<bool> running;
+    std::atomic<bool> failed;  // The server thread ended on an error, e.g. it could not listen
+
+    // Set by requestStop; the server thread sleeps on stateChanged until then
+    std::mutex stateMutex;
+    std::condition_variable stateChanged;
+    std::atomic<bool> stopRequested;
+
+    unsigned workerCount;        // Crow worker threads, 0 for one per hardware thread
+
+    // Waiting /api/changes requests each hold a worker, so at most half the workers wait at once
+    std::atomic<unsigned> changeWaiters;
+    unsigned maxChangeWaiters;
+    unsigned idleTimeoutSeconds;  // Idle keep-alive connections are closed after this
     int port;
     bool useHttps;
     std::string certFile;
     std::string keyFile;
 
     // Helper methods to interface with KeyManager
-    std::vector<Key> getAllKeys();
     bool addKey(const std::string& value, KeyType type);
-    bool markKeyAsUsed(int keyId, const std::string& discordUsername);
-    bool markKeyAsUnused(int keyId);
+    bool markKeyAsUsed(uint64_t keyId, const std::string& discordUsername);
+    bool markKeyAsUnused(uint64_t keyId);
+    std::optional<Key> claimKey(KeyType type, const std::string& discordUsername);
     std::string getStatsJson();
+    std::string getPersistenceStatsJson();
+
+    // Apply POST /api/keys/batch and render the result of each operation
+    crow::response applyBatch(const crow::request& req);
+
+    // Answer GET /api/changes, waiting for a change when there is none after since yet. Past
+    // maxChangeWaiters waiting requests, one with nothing to return gets 429 instead of waiting.
+    crow::response readChanges(const crow::request& req);
+
+    // ETag of the key lists and stats at a KeyManager version
+    std::string etagOf(uint64_t version) const;
+
+    // Render /api/keys and /api/keys/type/<int>, honouring the limit and cursor query parameters.
+    // The full lists, without either, are served from responseCache while the keys are unchanged.
+    crow::response renderKeyList(const crow::request& req, std::optional<KeyType> keyType);
+
+    // 200 with a body, compressed for the request's Accept-Encoding when it has at least
+    // compressionMinBytes. With a slot, compressed bodies are cached like the plain one.
+    crow::response sendBody(const crow::request& req, const ResponseCache::Body& body, const std::string& etag,
+        std::optional<ResponseCache::Slot> slot, uint64_t version);
 
     // Internal server runner method
     void runServer();
 
     // Setup routes for the Crow app
-    void setupRoutes(crow::SimpleApp& app);
+    void setupRoutes(ApiApp& app);
 
 public:
     ApiServer();
@@ -43,11 +102,34 @@ public:
         const std::string& sslCertFile = "server.crt",
         const std::string& sslKeyFile = "server.key");
 
-    // Stop the server
+    // Tune the journal group commit: how long a batch stays open and how many records close it early
+    void configurePersistence(std::chrono::microseconds commitWindow, size_t maxBatchSize);
+
+    // Crow worker threads (0 for one per hardware thread, half of them at most for waiting
+    // /api/changes requests) and the idle connection timeout (1 to 255 seconds). Takes
+    // effect on the next start().
+    void configureServer(unsigned workers, unsigned idleTimeout);
+
+    // Smallest body sent compressed to clients that accept gzip or deflate (SIZE_MAX turns compression off)
+    void configureCompression(size_t minBytes);
+
+    // Ask the server to stop without waiting for it. Not async-signal-safe: a signal
+    // handler should only set a flag for a normal thread to act on.
+    void requestStop();
+
+    // Block until requestStop or stop is called, or the server thread fails, giving up
+    // after timeout. True if a stop was requested.
+    bool waitForStopRequest(std::chrono::milliseconds timeout);
+
+    // Stop the server: finish the requests in flight (up to DRAIN_TIMEOUT), stop
+    // listening and make every change durable
     void stop();
 
     // Check if server is running
     bool isRunning() const;
+
+    // True if the last start() ended on an error instead of a stop request
+    bool hasFailed() const;
 };
 
 #endif // API_SERVER_H
\ No newline at end of file
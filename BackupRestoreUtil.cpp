@@ -1,29 +1,36 @@
 #include "BackupRestoreUtil.h"
 #include "FileManager.h"
+#include "StorageFactory.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <ctime>
+#include <filesystem>
+
+bool BackupRestoreUtil::readDatabase(std::string& contents) {
+    // Same storage stack as KeyManager, so journaled changes and the binary format are covered
+    auto storage = StorageFactory::createStorage();
+    if (!storage->exists()) {
+        return false;
+    }
+
+    contents = storage->loadKeys();
+    return true;
+}
 
 bool BackupRestoreUtil::backupDatabase(const std::string& filename) {
     try {
         // Get paths
-        std::string appDataPath = FileManager::getAppDataPath();
-        std::string databasePath = appDataPath + "keys.csv";
+        std::string databasePath = StorageFactory::getDatabasePath(StorageFactory::detectFormat());
         std::string backupPath = filename;
 
-        // Check if source file exists
-        std::ifstream sourceFile(databasePath);
-        if (!sourceFile.is_open()) {
+        // Read source file
+        std::string contents;
+        if (!readDatabase(contents)) {
             std::cerr << "Error: Cannot open database file for backup: " << databasePath << std::endl;
             return false;
         }
 
-        // Read source file
-        std::stringstream buffer;
-        buffer << sourceFile.rdbuf();
-        sourceFile.close();
-
         // Write to backup file
         std::ofstream backupFile(backupPath);
         if (!backupFile.is_open()) {
@@ -31,7 +38,7 @@ bool BackupRestoreUtil::backupDatabase(const std::string& filename) {
             return false;
         }
 
-        backupFile << buffer.str();
+        backupFile << contents;
         backupFile.close();
 
         std::cout << "Database successfully backed up to: " << backupPath << std::endl;
@@ -51,7 +58,7 @@ bool BackupRestoreUtil::restoreDatabase(const std::string& filename) {
     try {
         // Get paths
         std::string appDataPath = FileManager::getAppDataPath();
-        std::string databasePath = appDataPath + "keys.csv";
+        std::string databasePath = StorageFactory::getDatabasePath(StorageFactory::detectFormat());
         std::string backupPath = filename;
 
         // Check if backup file exists
@@ -71,27 +78,22 @@ bool BackupRestoreUtil::restoreDatabase(const std::string& filename) {
         std::string timestamp = std::to_string(now);
         std::string autoBackupPath = appDataPath + "keys_auto_backup_" + timestamp + ".csv";
 
-        std::ifstream currentDb(databasePath);
-        if (currentDb.is_open()) {
+        std::string currentContents;
+        if (readDatabase(currentContents)) {
             std::ofstream autoBackup(autoBackupPath);
             if (autoBackup.is_open()) {
-                autoBackup << currentDb.rdbuf();
+                autoBackup << currentContents;
                 autoBackup.close();
                 std::cout << "Created automatic backup of current database: " << autoBackupPath << std::endl;
             }
-            currentDb.close();
         }
 
-        // Write to database file
-        std::ofstream dbFile(databasePath);
-        if (!dbFile.is_open()) {
+        // Write to database file; this also empties the journal so it is not replayed over the restore
+        if (!StorageFactory::createStorage()->saveKeys(buffer.str())) {
             std::cerr << "Error: Cannot open database file for writing: " << databasePath << std::endl;
             return false;
         }
 
-        dbFile << buffer.str();
-        dbFile.close();
-
         std::cout << "Database successfully restored from: " << backupPath << std::endl;
         return true;
     }
@@ -111,6 +113,12 @@ void BackupRestoreUtil::repairDatabase() {
         std::string appDataPath = FileManager::getAppDataPath();
         std::string databasePath = appDataPath + "keys.csv";
 
+        if (StorageFactory::detectFormat() == StorageFormat::Binary) {
+            std::cout << "Database is in binary format; repair only applies to the text format." << std::endl;
+            std::cout << "Use convert_db text first to repair it." << std::endl;
+            return;
+        }
+
         // Check if database file exists
         std::ifstream dbFile(databasePath);
         if (!dbFile.is_open()) {
@@ -185,4 +193,72 @@ void BackupRestoreUtil::repairDatabase() {
     catch (...) {
         std::cerr << "Unknown error during repair" << std::endl;
     }
+}
+
+bool BackupRestoreUtil::convertDatabase(const std::string& format) {
+    try {
+        StorageFormat target;
+        if (format == "binary") {
+            target = StorageFormat::Binary;
+        }
+        else if (format == "text") {
+            target = StorageFormat::Text;
+        }
+        else {
+            std::cerr << "Error: Unknown database format '" << format << "'. Use 'text' or 'binary'." << std::endl;
+            return false;
+        }
+
+        StorageFormat current = StorageFactory::detectFormat();
+        if (current == target) {
+            std::cout << "Database is already in " << format << " format." << std::endl;
+            return true;
+        }
+
+        // Load through the journaled storage so pending journal records are folded in
+        KeyCollection collection;
+        {
+            auto storage = StorageFactory::createStorage();
+            if (!storage->exists()) {
+                std::cout << "No database file found to convert." << std::endl;
+                return false;
+            }
+            if (!storage->loadCollection(collection)) {
+                std::cerr << "Error: Cannot load database for conversion." << std::endl;
+                return false;
+            }
+        }
+
+        std::string targetPath = StorageFactory::getDatabasePath(target);
+        if (!StorageFactory::createSnapshotStorage(target)->saveCollection(collection)) {
+            std::cerr << "Error: Cannot write converted database: " << targetPath << std::endl;
+            return false;
+        }
+
+        // Retire the old snapshot before the journal, so a crash in between
+        // still loads the new snapshot with the (harmless) journal replayed on top
+        std::string currentPath = StorageFactory::getDatabasePath(current);
+        std::error_code ec;
+        std::filesystem::rename(currentPath, currentPath + ".bak", ec);
+        if (ec) {
+            std::cerr << "Error: Cannot retire old database " << currentPath << ": " << ec.message() << std::endl;
+            return false;
+        }
+
+        std::string journalPath = StorageFactory::getJournalPath();
+        std::filesystem::remove(journalPath, ec);
+        std::filesystem::remove(journalPath + ".old", ec);
+
+        std::cout << "Converted " << collection.size() << " keys to " << format << " format: " << targetPath << std::endl;
+        std::cout << "Previous database kept as: " << currentPath << ".bak" << std::endl;
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error during conversion: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error during conversion" << std::endl;
+        return false;
+    }
 }
\ No newline at end of file
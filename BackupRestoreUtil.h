@@ -5,6 +5,10 @@
 #include <vector>
 
 class BackupRestoreUtil {
+private:
+    // Read the database as text, with any journaled changes folded in
+    static bool readDatabase(std::string& contents);
+
 public:
     // Backup the database to a file
     static bool backupDatabase(const std::string& filename);
@@ -14,6 +18,9 @@ public:
 
     // Attempt to repair a corrupted database
     static void repairDatabase();
+
+    // Convert the database between the "text" and "binary" formats
+    static bool convertDatabase(const std::string& format);
 };
 
 #endif // BACKUP_RESTORE_UTIL_H
\ No newline at end of file
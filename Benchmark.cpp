@@ -0,0 +1,597 @@
+#include "Benchmark.h"
+#include "BinarySnapshotStorage.h"
+#include "FileSystemStorage.h"
+#include "JsonRenderer.h"
+#include "KeyManager.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// Storage that keeps everything in memory, so benchmarks never touch the real database
+class MemoryStorage : public IKeyStorage {
+private:
+    std::string data;
+
+public:
+    bool saveKeys(const std::string& serialized) override {
+        data = serialized;
+        return true;
+    }
+
+    std::string loadKeys() override {
+        return data;
+    }
+
+    bool exists() override {
+        return !data.empty();
+    }
+};
+
+// Storage that accepts journal records and drops them, so claim benchmarks measure locking rather than the disk
+class DiscardingJournalStorage : public MemoryStorage {
+private:
+    std::atomic<uint64_t> lastTicket{ 0 };
+
+public:
+    uint64_t appendRecord(const KeyView& key) override {
+        return ++lastTicket;
+    }
+};
+
+std::vector<std::string> Benchmark::generateLines(size_t keyCount) {
+    std::vector<std::string> lines;
+    lines.reserve(keyCount);
+
+    for (size_t i = 0; i < keyCount; i++) {
+        Key key("KEY-" + std::to_string(i) + "-ABCD-EFGH", static_cast<KeyType>(i % 4));
+        if (i % 3 == 0) {
+            key.setIsUsed(true);
+            key.setDiscordUsername("user" + std::to_string(i % 500));
+        }
+        lines.push_back(key.serialize());
+    }
+
+    return lines;
+}
+
+void Benchmark::runParserBenchmark(size_t keyCount) {
+    std::vector<std::string> lines = generateLines(keyCount);
+    std::string database;
+    for (const auto& line : lines) {
+        database += line;
+        database += '\n';
+    }
+
+    auto keysPerSecond = [keyCount](std::chrono::steady_clock::duration elapsed) {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? static_cast<size_t>(keyCount / seconds) : 0;
+    };
+
+    // Single records, separator detected per line
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& line : lines) {
+        checksum += Key::deserialize(line).getKeyValue().size();
+    }
+    auto recordTime = std::chrono::steady_clock::now() - start;
+
+    // Whole database, separator detected once and lines split in place
+    start = std::chrono::steady_clock::now();
+    KeyCollection collection = KeyCollection::deserialize(std::string_view(database));
+    auto collectionTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Parsed " << keyCount << " keys (checksum " << checksum + collection.size() << ")" << std::endl;
+    std::cout << "  Key::deserialize:           " << keysPerSecond(recordTime) << " keys/s" << std::endl;
+    std::cout << "  KeyCollection::deserialize: " << keysPerSecond(collectionTime) << " keys/s" << std::endl;
+}
+
+void Benchmark::runReadScalingBenchmark(size_t keyCount, unsigned maxThreads) {
+    auto storage = std::make_unique<MemoryStorage>();
+    std::string database;
+    for (const auto& line : generateLines(keyCount)) {
+        database += line;
+        database += '\n';
+    }
+    storage->saveKeys(database);
+    KeyManager keyManager(std::move(storage));
+
+    // A full walk of the keys under the read locks, as the list handlers do
+    auto readOnce = [&keyManager]() {
+        size_t used = 0;
+        keyManager.forEachKey(KeyFilter(), [&used](size_t, const KeyView& key) {
+            if (key.getIsUsed()) {
+                used++;
+            }
+        });
+        return used;
+    };
+
+    auto measure = [&readOnce](unsigned threadCount, std::mutex* serializeOn) {
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> reads(0);
+        std::vector<std::thread> workers;
+
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back([&]() {
+                size_t local = 0;
+                while (!stop) {
+                    if (serializeOn) {
+                        std::lock_guard<std::mutex> lock(*serializeOn);
+                        readOnce();
+                    }
+                    else {
+                        readOnce();
+                    }
+                    local++;
+                }
+                reads += local;
+            });
+        }
+
+        auto duration = std::chrono::milliseconds(1000);
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        return static_cast<size_t>(reads / std::chrono::duration<double>(duration).count());
+    };
+
+    std::cout << "Full-list reads per second over " << keyCount << " keys" << std::endl;
+    std::cout << "Threads | Shared lock | Single mutex" << std::endl;
+
+    std::mutex globalMutex;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        std::cout << threads << " | " << measure(threads, nullptr) << " | " << measure(threads, &globalMutex) << std::endl;
+    }
+}
+
+void Benchmark::runClaimScalingBenchmark(size_t keyCount, unsigned maxThreads) {
+    std::string database;
+    for (size_t i = 0; i < keyCount; i++) {
+        database += Key("CLAIM-" + std::to_string(i) + "-ABCD-EFGH", KeyType::Day).serialize();
+        database += '\n';
+    }
+
+    // Fixed work: the threads claim until every key is gone
+    auto measure = [&database](unsigned threadCount, size_t shardCount) {
+        auto storage = std::make_unique<DiscardingJournalStorage>();
+        storage->saveKeys(database);
+        KeyManager keyManager(std::move(storage), shardCount);
+
+        std::atomic<size_t> claims(0);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back([&]() {
+                size_t local = 0;
+                while (keyManager.claimKey(KeyType::Day, "benchmark")) {
+                    local++;
+                }
+                claims += local;
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return seconds > 0 ? static_cast<size_t>(claims / seconds) : 0;
+    };
+
+    std::cout << "Claims per second over " << keyCount << " keys" << std::endl;
+    std::cout << "Threads | 1 shard | " << KeyManager::DEFAULT_SHARD_COUNT << " shards" << std::endl;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        size_t single = measure(threads, 1);
+        size_t sharded = measure(threads, KeyManager::DEFAULT_SHARD_COUNT);
+        std::cout << threads << " | " << single << " | " << sharded << std::endl;
+    }
+}
+
+void Benchmark::runMemoryBenchmark(size_t keyCount) {
+    KeyCollection collection;
+    collection.reserve(keyCount);
+
+    // 23 character keys as vendors ship them, usernames drawn from 50,000 users
+    char value[32];
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < keyCount; i++) {
+        std::snprintf(value, sizeof(value), "%05zu-%05zu-ABCDE-%05zu", i % 99991, (i * 7) % 99991, (i / 1000) % 100000);
+        bool used = i % 2 == 1;
+        std::string username = used ? "user" + std::to_string(i % 50000) + "#1234" : std::string();
+        collection.addKey(KeyView(value, Key::packState(static_cast<KeyType>(i % 4), used), username));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t bytes = collection.memoryUsage();
+    std::cout << "Stored " << collection.size() << " keys in " << seconds << " s" << std::endl;
+    std::cout << "  Memory: " << bytes / (1024 * 1024) << " MB, "
+        << (collection.size() ? static_cast<double>(bytes) / collection.size() : 0.0) << " bytes/key" << std::endl;
+}
+
+bool DatasetOptions::parseOption(const std::string& arg) {
+    size_t equals = arg.find('=');
+    if (arg.rfind("--", 0) != 0 || equals == std::string::npos) {
+        return false;
+    }
+
+    std::string name = arg.substr(2, equals - 2);
+    std::string value = arg.substr(equals + 1);
+    if (name == "keys") {
+        keyCount = std::stoull(value);
+    }
+    else if (name == "types") {
+        std::stringstream list(value);
+        std::string weight;
+        for (double& typeWeight : typeWeights) {
+            if (!std::getline(list, weight, ',')) {
+                throw std::invalid_argument("--types needs four comma separated weights");
+            }
+            typeWeight = std::stod(weight);
+        }
+    }
+    else if (name == "used") {
+        usedRatio = std::stod(value);
+    }
+    else if (name == "users") {
+        userCount = std::stoull(value);
+    }
+    else if (name == "skew") {
+        userSkew = std::stod(value);
+    }
+    else if (name == "seed") {
+        seed = std::stoull(value);
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// splitmix64 finalizer. It is a bijection, so distinct numbers give distinct keys.
+static uint64_t mixBits(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Vendor style XXXXX-XXXXX-XXXXX-XXXXX key: the first 13 characters spell out all
+// 64 bits of the mixed number, the rest are filler derived from it
+static std::string syntheticKey(uint64_t seed, uint64_t number) {
+    static const char alphabet[] = "ABCDEFGHJKLMNPQRSTUVWXYZ23456789";
+    uint64_t bits = mixBits(seed * 0x9e3779b97f4a7c15ULL + number);
+    uint64_t filler = mixBits(bits);
+
+    std::string key;
+    key.reserve(23);
+    for (int i = 0; i < 20; i++) {
+        if (i > 0 && i % 5 == 0) {
+            key += '-';
+        }
+        uint64_t digit = i < 13 ? bits >> (5 * i) : filler >> (5 * (i - 13));
+        key += alphabet[digit & 31];
+    }
+    return key;
+}
+
+// Uniform in [0, 1), identical on every standard library unlike std::uniform_real_distribution
+static double uniformUnit(std::mt19937_64& rng) {
+    return (rng() >> 11) * 0x1.0p-53;
+}
+
+// Index drawn with probability proportional to its share of the running totals in cumulative
+static size_t pickWeighted(std::mt19937_64& rng, const std::vector<double>& cumulative) {
+    double target = uniformUnit(rng) * cumulative.back();
+    size_t index = std::upper_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin();
+    return std::min(index, cumulative.size() - 1);
+}
+
+static std::string syntheticUsername(size_t rank) {
+    return "player" + std::to_string(rank) + "#" + std::to_string(1000 + mixBits(rank) % 9000);
+}
+
+// Running totals of 1/rank^skew, so a few heavy users hold most of the claimed keys
+static std::vector<double> zipfWeights(const DatasetOptions& options) {
+    std::vector<double> cumulative(options.userCount);
+    double total = 0;
+    for (size_t rank = 0; rank < options.userCount; rank++) {
+        total += 1.0 / std::pow(static_cast<double>(rank + 1), options.userSkew);
+        cumulative[rank] = total;
+    }
+    return cumulative;
+}
+
+KeyCollection Benchmark::generateDataset(const DatasetOptions& options) {
+    double typeTotal = 0;
+    std::vector<double> typeCumulative;
+    for (double weight : options.typeWeights) {
+        if (weight < 0) {
+            throw std::invalid_argument("Key type weights must not be negative");
+        }
+        typeTotal += weight;
+        typeCumulative.push_back(typeTotal);
+    }
+    if (typeTotal <= 0) {
+        throw std::invalid_argument("At least one key type weight must be positive");
+    }
+    if (options.usedRatio < 0 || options.usedRatio > 1) {
+        throw std::invalid_argument("Used ratio must be between 0 and 1");
+    }
+    if (options.userCount == 0 || options.userSkew < 0) {
+        throw std::invalid_argument("Need at least one user and a non-negative skew");
+    }
+
+    std::vector<std::string> usernames;
+    usernames.reserve(options.userCount);
+    for (size_t rank = 0; rank < options.userCount; rank++) {
+        usernames.push_back(syntheticUsername(rank));
+    }
+    std::vector<double> userCumulative = zipfWeights(options);
+
+    std::mt19937_64 rng(options.seed);
+    KeyCollection collection;
+    collection.reserve(options.keyCount, options.keyCount * 23);
+
+    for (size_t i = 0; i < options.keyCount; i++) {
+        std::string value = syntheticKey(options.seed, i);
+        KeyType type = static_cast<KeyType>(pickWeighted(rng, typeCumulative));
+        bool used = uniformUnit(rng) < options.usedRatio;
+        std::string_view username = used ? std::string_view(usernames[pickWeighted(rng, userCumulative)]) : std::string_view();
+        collection.addKey(KeyView(value, Key::packState(type, used), username));
+    }
+
+    return collection;
+}
+
+bool Benchmark::writeDataset(const DatasetOptions& options, const std::string& path) {
+    KeyCollection collection = generateDataset(options);
+    std::string serialized = collection.serialize();
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Unable to open file for writing: " << path << std::endl;
+        return false;
+    }
+    file.write(serialized.data(), serialized.size());
+    file.close();
+    if (file.fail()) {
+        std::cerr << "Error: Unable to write dataset to " << path << std::endl;
+        return false;
+    }
+
+    KeyStats stats = collection.getStats();
+    std::cout << "Wrote " << stats.totalKeys() << " keys (" << stats.usedKeys() << " used) to " << path << std::endl;
+    return true;
+}
+
+// One line of the suite report
+struct SuiteResult {
+    std::string name;
+    size_t items;    // Keys, lines or queries handled per run
+    size_t bytes;    // Bytes read or produced per run, 0 where it does not apply
+    double seconds;  // Fastest run
+};
+
+bool Benchmark::runSuite(const DatasetOptions& options, const std::string& outputPath, unsigned repeat) {
+    const size_t QUERY_COUNT = 10000;
+    const size_t PAGE_COUNT = 1000;
+    const size_t PAGE_SIZE = 100;
+    repeat = std::max(repeat, 1u);
+
+    std::vector<SuiteResult> results;
+    auto measure = [&results](const std::string& name, size_t items, unsigned runs,
+        const std::function<void()>& setup, const std::function<size_t()>& body) {
+        SuiteResult result{ name, items, 0, 0 };
+        for (unsigned run = 0; run < runs; run++) {
+            if (setup) {
+                setup();
+            }
+            auto start = std::chrono::steady_clock::now();
+            result.bytes = body();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || seconds < result.seconds) {
+                result.seconds = seconds;
+            }
+        }
+        results.push_back(result);
+    };
+
+    // Queries follow the same skew as the claims, so hot users are asked for most often
+    std::mt19937_64 rng(options.seed + 1);
+    std::vector<double> userCumulative = zipfWeights(options);
+    std::vector<std::string> queries;
+    std::vector<std::string> fragments;
+    for (size_t i = 0; i < QUERY_COUNT; i++) {
+        queries.push_back(syntheticUsername(pickWeighted(rng, userCumulative)));
+        // The user number and the start of the discriminator, as in a partial name search
+        const std::string& query = queries.back();
+        fragments.push_back(query.substr(6, query.find('#') - 4));
+    }
+    size_t checksum = 0;
+
+    // Generation and the text format
+    KeyCollection collection;
+    measure("dataset.generate", options.keyCount, 1, nullptr, [&]() {
+        collection = generateDataset(options);
+        return collection.memoryUsage();
+    });
+
+    std::string serialized;
+    measure("collection.serialize", collection.size(), repeat, nullptr, [&]() {
+        serialized = collection.serialize();
+        return serialized.size();
+    });
+    measure("collection.deserialize", collection.size(), repeat, nullptr, [&]() {
+        checksum += KeyCollection::deserialize(std::string_view(serialized)).size();
+        return serialized.size();
+    });
+
+    // Both storage backends, in a scratch directory
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "kms-benchmark";
+    std::filesystem::create_directories(directory);
+    std::string textPath = (directory / "keys.csv").string();
+    std::string binaryPath = (directory / "keys.bin").string();
+    FileSystemStorage textStorage(textPath);
+    BinarySnapshotStorage binaryStorage(binaryPath);
+
+    auto saveWith = [&collection](IKeyStorage& storage, const std::string& path) {
+        if (!storage.saveCollection(collection)) {
+            throw std::runtime_error("Unable to save benchmark database to " + path);
+        }
+        return static_cast<size_t>(std::filesystem::file_size(path));
+    };
+    auto loadWith = [&checksum](IKeyStorage& storage, const std::string& path) {
+        KeyCollection loaded;
+        if (!storage.loadCollection(loaded)) {
+            throw std::runtime_error("Unable to load benchmark database from " + path);
+        }
+        checksum += loaded.size();
+        return static_cast<size_t>(std::filesystem::file_size(path));
+    };
+    measure("storage.text.save", collection.size(), repeat, nullptr, [&]() { return saveWith(textStorage, textPath); });
+    measure("storage.text.load", collection.size(), repeat, nullptr, [&]() { return loadWith(textStorage, textPath); });
+    measure("storage.binary.save", collection.size(), repeat, nullptr, [&]() { return saveWith(binaryStorage, binaryPath); });
+    measure("storage.binary.load", collection.size(), repeat, nullptr, [&]() { return loadWith(binaryStorage, binaryPath); });
+
+    // An import file of new keys, with every 20th line a key already in the database
+    std::string importPath = (directory / "import.txt").string();
+    {
+        std::ofstream importFile(importPath, std::ios::binary);
+        for (size_t i = 0; i < options.keyCount; i++) {
+            importFile << syntheticKey(options.seed, i % 20 == 19 ? i : options.keyCount + i) << '\n';
+        }
+    }
+    size_t importBytes = static_cast<size_t>(std::filesystem::file_size(importPath));
+
+    measure("import.parse", options.keyCount, repeat, nullptr, [&]() {
+        ImportReport report;
+        checksum += KeyImporter::importFromFile(importPath, report).size();
+        return importBytes;
+    });
+
+    // KeyManager over an in-memory copy of the database, as the API server uses it
+    auto makeManager = [&serialized]() {
+        auto storage = std::make_unique<MemoryStorage>();
+        storage->saveKeys(serialized);
+        return std::make_unique<KeyManager>(std::move(storage));
+    };
+    std::unique_ptr<KeyManager> importManager;
+    measure("import.keyManager", options.keyCount, repeat, [&]() { importManager = makeManager(); }, [&]() {
+        checksum += importManager->importKeysFromFile(importPath, KeyType::Day).imported;
+        return importBytes;
+    });
+    importManager.reset();
+
+    // Username lookups
+    measure("search.findByUsername", QUERY_COUNT, repeat, nullptr, [&]() {
+        for (const auto& query : queries) {
+            checksum += collection.findByUsername(query).size();
+        }
+        return size_t(0);
+    });
+    measure("search.searchByUsername", QUERY_COUNT, repeat, nullptr, [&]() {
+        for (const auto& fragment : fragments) {
+            checksum += collection.searchByUsername(fragment).size();
+        }
+        return size_t(0);
+    });
+    measure("search.searchByDiscordUsername", QUERY_COUNT, repeat, nullptr, [&]() {
+        for (const auto& query : queries) {
+            checksum += collection.searchByDiscordUsername(query).size();
+        }
+        return size_t(0);
+    });
+
+    // Response bodies of the API routes
+    std::unique_ptr<KeyManager> keyManager = makeManager();
+    std::vector<size_t> cursors;
+    for (size_t i = 0; i < PAGE_COUNT; i++) {
+        cursors.push_back(collection.size() ? rng() % collection.size() : 0);
+    }
+
+    measure("json.stats", QUERY_COUNT, repeat, nullptr, [&]() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < QUERY_COUNT; i++) {
+            bytes += JsonRenderer::renderStats(keyManager->getStats()).size();
+        }
+        return bytes;
+    });
+    measure("json.keys.page", PAGE_COUNT, repeat, nullptr, [&]() {
+        size_t bytes = 0;
+        for (size_t cursor : cursors) {
+            bytes += JsonRenderer::renderKeyList(*keyManager, std::nullopt, cursor, PAGE_SIZE).size();
+        }
+        return bytes;
+    });
+    measure("json.keys.typePage", PAGE_COUNT, repeat, nullptr, [&]() {
+        size_t bytes = 0;
+        for (size_t cursor : cursors) {
+            bytes += JsonRenderer::renderKeyList(*keyManager, KeyType::Lifetime, cursor, PAGE_SIZE).size();
+        }
+        return bytes;
+    });
+    measure("json.keys.full", collection.size(), repeat, nullptr, [&]() {
+        return JsonRenderer::renderKeyList(*keyManager, std::nullopt, 0, std::nullopt).size();
+    });
+    measure("json.userKeys", QUERY_COUNT, repeat, nullptr, [&]() {
+        size_t bytes = 0;
+        for (const auto& query : queries) {
+            bytes += JsonRenderer::renderUserKeys(*keyManager, query, false).size();
+        }
+        return bytes;
+    });
+
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+
+    // Machine readable report
+    std::ostringstream json;
+    json << R"({"dataset":{"keys":)" << options.keyCount << R"(,"typeWeights":[)"
+        << options.typeWeights[0] << ',' << options.typeWeights[1] << ','
+        << options.typeWeights[2] << ',' << options.typeWeights[3]
+        << R"(],"usedRatio":)" << options.usedRatio << R"(,"users":)" << options.userCount
+        << R"(,"userSkew":)" << options.userSkew << R"(,"seed":)" << options.seed << "},";
+    json << R"("repeat":)" << repeat << R"(,"hardwareThreads":)" << std::thread::hardware_concurrency()
+        << R"(,"checksum":)" << checksum << R"(,"results":[)";
+
+    std::cout << "Benchmark suite over " << collection.size() << " keys (fastest of " << repeat << " runs)" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const SuiteResult& result = results[i];
+        double itemsPerSecond = result.seconds > 0 ? result.items / result.seconds : 0;
+        double megabytesPerSecond = result.seconds > 0 ? result.bytes / result.seconds / (1024 * 1024) : 0;
+
+        if (i > 0) json << ',';
+        json << R"({"name":")" << result.name << R"(","items":)" << result.items
+            << R"(,"bytes":)" << result.bytes << R"(,"seconds":)" << result.seconds
+            << R"(,"itemsPerSecond":)" << static_cast<uint64_t>(itemsPerSecond)
+            << R"(,"megabytesPerSecond":)" << megabytesPerSecond << '}';
+
+        std::cout << "  " << result.name << ": " << result.seconds << " s, "
+            << static_cast<uint64_t>(itemsPerSecond) << " items/s" << std::endl;
+    }
+    json << "]}";
+
+    std::ofstream output(outputPath, std::ios::binary);
+    output << json.str();
+    output.close();
+    if (output.fail()) {
+        std::cerr << "Error: Unable to write benchmark results to " << outputPath << std::endl;
+        return false;
+    }
+
+    std::cout << "Results written to " << outputPath << std::endl;
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "KeyCollection.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a synthetic key database
+struct DatasetOptions {
+    size_t keyCount = 1000000;
+    double typeWeights[4] = { 40, 30, 20, 10 };  // Relative share of Day, Week, Month and Lifetime keys
+    double usedRatio = 0.5;                      // Fraction of keys already claimed
+    size_t userCount = 50000;                    // Distinct usernames holding the claimed keys
+    double userSkew = 1.0;                       // Zipf exponent; 0 spreads claims evenly over the users
+    uint64_t seed = 42;
+
+    // Apply a --keys=, --types=d,w,m,l, --used=, --users=, --skew= or --seed= argument.
+    // Returns false if arg is not one of them.
+    bool parseOption(const std::string& arg);
+};
+
+// Micro benchmarks for the hot paths, run from the command line
+class Benchmark {
+private:
+    // Synthetic lines in the keys.csv format
+    static std::vector<std::string> generateLines(size_t keyCount);
+
+public:
+    // Keys per second for single records and for a whole database
+    static void runParserBenchmark(size_t keyCount);
+
+    // Full-list reads per second through KeyManager as the number of worker
+    // threads grows, compared with every read serialized on one mutex
+    static void runReadScalingBenchmark(size_t keyCount, unsigned maxThreads);
+
+    // Claims per second through KeyManager as the number of worker threads grows,
+    // with every key in one shard compared with the default shard count
+    static void runClaimScalingBenchmark(size_t keyCount, unsigned maxThreads);
+
+    // Bytes per key held by a KeyCollection of vendor format keys, half of them claimed
+    static void runMemoryBenchmark(size_t keyCount);
+
+    // Deterministic synthetic database: the same options always give the same keys
+    static KeyCollection generateDataset(const DatasetOptions& options);
+
+    // Write a generated database in the keys.csv format
+    static bool writeDataset(const DatasetOptions& options, const std::string& path);
+
+    // Time every hot path (parsing, storage, import, search, JSON rendering) on a
+    // generated database and write the results to outputPath as JSON. Bulk steps
+    // run repeat times and report the fastest run.
+    static bool runSuite(const DatasetOptions& options, const std::string& outputPath, unsigned repeat);
+};
+
+#endif // BENCHMARK_H
\ No newline at end of file
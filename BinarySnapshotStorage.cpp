@@ -0,0 +1,234 @@
+#include "BinarySnapshotStorage.h"
+#include "DurableFile.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    // Write any source with size() and at(index) returning a KeyView, so both a
+    // KeyCollection and a flat KeySnapshot are written without converting them
+    template <typename Keys>
+    bool writeSnapshot(const std::string& filePath, const Keys& keys, std::atomic<uint64_t>& bytesWritten) {
+        using Header = BinarySnapshotStorage::Header;
+        using Record = BinarySnapshotStorage::Record;
+        constexpr uint8_t RECORD_FLAGS = BinarySnapshotStorage::TYPE_MASK | BinarySnapshotStorage::USED_FLAG;
+
+        std::vector<Record> records;
+        records.reserve(keys.size());
+        std::string stringTable;
+
+        // Usernames repeat a lot, so each distinct one is stored once
+        std::unordered_map<std::string, uint32_t> usernameOffsets;
+
+        auto appendString = [&stringTable](std::string_view value) {
+            uint32_t offset = static_cast<uint32_t>(stringTable.size());
+            stringTable += value;
+            return offset;
+        };
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            KeyView key = keys.at(i);
+            std::string_view keyValue = key.getKeyValue();
+            std::string_view username = key.getDiscordUsername();
+
+            Record record;
+            record.keyLength = static_cast<uint32_t>(keyValue.size());
+            record.keyOffset = appendString(keyValue);
+            record.usernameLength = static_cast<uint32_t>(username.size());
+            record.usernameOffset = 0;
+            if (!username.empty()) {
+                auto found = usernameOffsets.find(std::string(username));
+                if (found != usernameOffsets.end()) {
+                    record.usernameOffset = found->second;
+                }
+                else {
+                    record.usernameOffset = appendString(username);
+                    usernameOffsets.emplace(std::string(username), record.usernameOffset);
+                }
+            }
+            record.flags = key.getState() & RECORD_FLAGS;
+            record.id = key.getId();
+
+            records.push_back(record);
+        }
+
+        if (stringTable.size() > UINT32_MAX) {
+            std::cerr << "Error: Binary snapshot string table exceeds 4 GB" << std::endl;
+            return false;
+        }
+
+        Header header;
+        std::memcpy(header.magic, BinarySnapshotStorage::MAGIC, sizeof(header.magic));
+        header.version = BinarySnapshotStorage::FORMAT_VERSION;
+        header.recordCount = records.size();
+        header.stringTableSize = stringTable.size();
+
+        // Write to a temporary file and swap it in, like FileSystemStorage
+        std::string tempPath = filePath + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Error: Unable to open file for writing: " << tempPath << std::endl;
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+        file.write(stringTable.data(), stringTable.size());
+        file.close();
+
+        if (file.fail()) {
+            std::cerr << "Error: Unable to write binary snapshot: " << tempPath << std::endl;
+            return false;
+        }
+
+        // Synced before and after the rename, so a checkpoint may drop the journal it covers
+        if (!DurableFile::replace(tempPath, filePath)) {
+            return false;
+        }
+
+        bytesWritten += sizeof(header) + records.size() * sizeof(Record) + stringTable.size();
+        return true;
+    }
+}
+
+BinarySnapshotStorage::BinarySnapshotStorage(const std::string& path) : filePath(path) {}
+
+bool BinarySnapshotStorage::saveKeys(const std::string& data) {
+    return saveCollection(KeyCollection::deserialize(data));
+}
+
+std::string BinarySnapshotStorage::loadKeys() {
+    KeyCollection collection;
+    if (!loadCollection(collection)) {
+        return "";
+    }
+    return collection.serialize();
+}
+
+bool BinarySnapshotStorage::exists() {
+    std::error_code ec;
+    return std::filesystem::exists(filePath, ec);
+}
+
+bool BinarySnapshotStorage::readRecords(const RecordVisitor& apply, KeyCollection* reserveFor) {
+    try {
+        MappedFile file;
+        if (!file.open(filePath)) {
+            std::cerr << "Error: Unable to open file for reading: " << filePath << std::endl;
+            return false;
+        }
+
+        Header header;
+        if (file.size() < sizeof(header)) {
+            std::cerr << "Error: Binary snapshot is truncated: " << filePath << std::endl;
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version < 1 || header.version > FORMAT_VERSION) {
+            std::cerr << "Error: Unsupported binary snapshot format: " << filePath << std::endl;
+            return false;
+        }
+        size_t recordSize = header.version == 1 ? sizeof(RecordV1) : sizeof(Record);
+
+        // Records and string table must fit exactly in the file
+        uint64_t available = file.size() - sizeof(header);
+        if (header.recordCount > available / recordSize ||
+            header.stringTableSize != available - header.recordCount * recordSize) {
+            std::cerr << "Error: Binary snapshot is corrupt: " << filePath << std::endl;
+            return false;
+        }
+
+        const char* records = file.data() + sizeof(header);
+        const char* strings = records + header.recordCount * recordSize;
+        uint64_t stringTableSize = header.stringTableSize;
+
+        // A version 1 record is a version 2 record without the trailing id
+        auto recordAt = [records, recordSize](uint64_t i) {
+            Record record;
+            record.id = NO_KEY_ID;
+            std::memcpy(&record, records + i * recordSize, recordSize);
+            return record;
+        };
+
+        for (uint64_t i = 0; i < header.recordCount; i++) {
+            Record record = recordAt(i);
+            if (static_cast<uint64_t>(record.keyOffset) + record.keyLength > stringTableSize ||
+                static_cast<uint64_t>(record.usernameOffset) + record.usernameLength > stringTableSize) {
+                std::cerr << "Error: Binary snapshot record " << i << " is out of range" << std::endl;
+                return false;
+            }
+        }
+
+        if (reserveFor) {
+            reserveFor->reserve(static_cast<size_t>(header.recordCount), static_cast<size_t>(stringTableSize));
+        }
+
+        for (uint64_t i = 0; i < header.recordCount; i++) {
+            // Views straight into the mapping; the receiver copies what it keeps
+            Record record = recordAt(i);
+            apply(KeyView(std::string_view(strings + record.keyOffset, record.keyLength),
+                record.flags & (TYPE_MASK | USED_FLAG),
+                std::string_view(strings + record.usernameOffset, record.usernameLength), record.id));
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading from file: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error loading from file" << std::endl;
+        return false;
+    }
+}
+
+bool BinarySnapshotStorage::loadCollection(KeyCollection& collection) {
+    KeyCollection loaded;
+    if (!readRecords([&loaded](const KeyView& key) { loaded.addKey(key); }, &loaded)) {
+        return false;
+    }
+
+    collection = std::move(loaded);
+    return true;
+}
+
+bool BinarySnapshotStorage::loadRecords(const RecordVisitor& apply) {
+    return readRecords(apply, nullptr);
+}
+
+bool BinarySnapshotStorage::saveCollection(const KeyCollection& collection) {
+    try {
+        return writeSnapshot(filePath, collection, bytesWritten);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving to file: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error saving to file" << std::endl;
+        return false;
+    }
+}
+
+bool BinarySnapshotStorage::saveRecords(const KeySnapshot& snapshot) {
+    try {
+        return writeSnapshot(filePath, snapshot, bytesWritten);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving to file: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error saving to file" << std::endl;
+        return false;
+    }
+}
+
+uint64_t BinarySnapshotStorage::getBytesWritten() {
+    return bytesWritten;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef BINARYSNAPSHOTSTORAGE_H
+#define BINARYSNAPSHOTSTORAGE_H
+
+#include "IKeyStorage.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Versioned binary snapshot storage.
+// Layout: header, fixed size records, then a string table holding key values
+// and (deduplicated) usernames. The file is memory mapped on load and records
+// point straight into the string table, so there is no text parsing.
+class BinarySnapshotStorage : public IKeyStorage {
+public:
+    static constexpr char MAGIC[4] = { 'K', 'M', 'S', 'B' };
+    static constexpr uint32_t FORMAT_VERSION = 2;
+
+    // Record flags: bits 0-1 key type, bit 2 used
+    static constexpr uint8_t TYPE_MASK = 0x03;
+    static constexpr uint8_t USED_FLAG = 0x04;
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t recordCount;
+        uint64_t stringTableSize;
+    };
+
+    struct Record {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t usernameOffset;
+        uint32_t usernameLength;
+        uint8_t flags;
+        uint64_t id;  // NO_KEY_ID if the key had none
+    };
+
+    // Version 1 records, from before keys had ids; still loaded
+    struct RecordV1 {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t usernameOffset;
+        uint32_t usernameLength;
+        uint8_t flags;
+    };
+#pragma pack(pop)
+
+private:
+    std::string filePath;
+    std::atomic<uint64_t> bytesWritten{ 0 };
+
+    // Map the file, check every record, then hand them to apply in file order. Nothing is
+    // applied from a corrupt file. reserveFor, if set, is sized for the records first.
+    bool readRecords(const RecordVisitor& apply, KeyCollection* reserveFor);
+
+public:
+    BinarySnapshotStorage(const std::string& path);
+
+    // Text data is converted to and from the binary layout
+    bool saveKeys(const std::string& data) override;
+    std::string loadKeys() override;
+    bool exists() override;
+
+    bool loadCollection(KeyCollection& collection) override;
+    bool loadRecords(const RecordVisitor& apply) override;
+    bool saveCollection(const KeyCollection& collection) override;
+    bool saveRecords(const KeySnapshot& snapshot) override;
+    uint64_t getBytesWritten() override;
+};
+
+#endif // BINARYSNAPSHOTSTORAGE_H
\ No newline at end of file
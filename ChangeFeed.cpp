@@ -0,0 +1,65 @@
+#include "ChangeFeed.h"
+#include <algorithm>
+
+ChangeFeed::ChangeFeed(size_t capacity) : ring(std::max<size_t>(capacity, 1)) {
+}
+
+uint64_t ChangeFeed::publish(Kind kind, const KeyView& key) {
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        version = latest.load(std::memory_order_relaxed) + 1;
+
+        // Assigning into the slot reuses the capacity of the strings it held before
+        Change& slot = ring[version % ring.size()];
+        slot.version = version;
+        slot.kind = kind;
+        slot.keyValue.assign(key.getKeyValue());
+        slot.keyType = key.getKeyType();
+        slot.discordUsername.assign(kind == Kind::Used ? key.getDiscordUsername() : std::string_view());
+
+        latest.store(version, std::memory_order_release);
+    }
+    changed.notify_all();
+    return version;
+}
+
+uint64_t ChangeFeed::latestVersion() const {
+    return latest.load(std::memory_order_acquire);
+}
+
+ChangeFeed::ReadResult ChangeFeed::read(uint64_t since, size_t limit, std::chrono::milliseconds timeout,
+    std::vector<Change>& changes) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [this, since]() {
+        return latest.load(std::memory_order_relaxed) != since || closed;
+    });
+
+    uint64_t newest = latest.load(std::memory_order_relaxed);
+    if (since > newest || newest - since > ring.size()) {
+        return ReadResult::ResyncRequired;
+    }
+    if (since == newest) {
+        return ReadResult::Timeout;
+    }
+
+    uint64_t last = std::min<uint64_t>(newest, since + std::max<size_t>(limit, 1));
+    changes.reserve(changes.size() + static_cast<size_t>(last - since));
+    for (uint64_t version = since + 1; version <= last; version++) {
+        changes.push_back(ring[version % ring.size()]);
+    }
+    return ReadResult::Changes;
+}
+
+void ChangeFeed::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    changed.notify_all();
+}
+
+void ChangeFeed::reopen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = false;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef CHANGEFEED_H
+#define CHANGEFEED_H
+
+#include "Key.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Ring buffer of the most recent changes to the keys, numbered by version.
+// Publishing assigns the next version, so the versions of changes on different
+// shards still form one gapless sequence. Readers ask for everything after a
+// version and may wait for it to arrive; once the ring has moved past that
+// version they have to resync from a full key list instead.
+class ChangeFeed {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 65536;
+
+    enum class Kind { Added, Used, Unused };
+
+    struct Change {
+        uint64_t version = 0;
+        Kind kind = Kind::Added;
+        std::string keyValue;
+        KeyType keyType = KeyType::Day;
+        std::string discordUsername;  // Holder after the change, empty unless Used
+    };
+
+    enum class ReadResult {
+        Changes,        // changes holds at least one change
+        Timeout,        // Nothing newer arrived in time
+        ResyncRequired  // The changes after since are gone (or since is from another run)
+    };
+
+    explicit ChangeFeed(size_t capacity = DEFAULT_CAPACITY);
+
+    // Record a change and return its version; wakes every waiting reader
+    uint64_t publish(Kind kind, const KeyView& key);
+
+    // Version of the latest change, 0 before the first
+    uint64_t latestVersion() const;
+
+    // Copy up to limit changes after since into changes, oldest first. Waits up to timeout
+    // for one to arrive when there is none yet, and not at all once the feed is closed.
+    ReadResult read(uint64_t since, size_t limit, std::chrono::milliseconds timeout, std::vector<Change>& changes);
+
+    // Wake every waiting reader and make later reads return without waiting, e.g. when the
+    // server stops. A read that starts after close, even just after, never sleeps.
+    void close();
+
+    // Let reads wait again, e.g. when the server is started again
+    void reopen();
+
+private:
+    std::vector<Change> ring;  // Version v lives at v % ring.size()
+    std::atomic<uint64_t> latest{ 0 };
+    bool closed = false;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+};
+
+#endif // CHANGEFEED_H
\ No newline at end of file
@@ -2,9 +2,11 @@
 API client for the Key Management System.
 """
 import aiohttp
+import asyncio
 import logging
 import json
 from typing import Dict, Any, Optional, Union
+from urllib.parse import quote
 
 logger = logging.getLogger(__name__)
 
@@ -150,6 +152,42 @@ class KeyManagementAPI:
             logger.error(f"Error adding key: {str(e)}")
             return False
     
+    async def get_key_by_value(self, key_value: str) -> Optional[Dict[str, Any]]:
+        """
+        Look up a single key by its value.
+        
+        Args:
+            key_value: The key value
+            
+        Returns:
+            Optional[Dict[str, Any]]: The key, or None if it does not exist
+        """
+        try:
+            return await self._request("GET", f"keys/value/{quote(key_value, safe='')}")
+        except APIError as e:
+            if e.status == 404:
+                return None
+            raise
+    
+    async def mark_key_as_unused_by_value(self, key_value: str) -> bool:
+        """
+        Mark a key as unused by its value.
+        
+        Args:
+            key_value: The key value
+            
+        Returns:
+            bool: True if successful, False otherwise
+        """
+        try:
+            response = await self._request("PUT", f"keys/value/{quote(key_value, safe='')}/unuse")
+            return response.get("status") == "success"
+        except APIError:
+            return False
+        except Exception as e:
+            logger.error(f"Error marking key as unused: {str(e)}")
+            return False
+    
     async def mark_key_as_used(self, key_id: Union[str, int], discord_username: str) -> bool:
         """
         Mark a key as used.
@@ -193,6 +231,35 @@ class KeyManagementAPI:
             logger.error(f"Error marking key as unused: {str(e)}")
             return False
     
+    async def claim_key(self, key_type: Union[str, int], discord_username: str) -> Optional[Dict[str, Any]]:
+        """
+        Atomically claim the next available key of a type.
+        
+        Args:
+            key_type: Key type ID (0=Day, 1=Week, 2=Month, 3=Lifetime)
+            discord_username: Discord username of the user
+            
+        Returns:
+            Optional[Dict[str, Any]]: The claimed key, or None if none are available
+            
+        Raises:
+            APIError: If the claim failed. A claim is not idempotent, so it is
+                sent only once; status 0 means the response was lost and the
+                key may have been claimed anyway.
+        """
+        data = {
+            "type": int(key_type),
+            "discordUsername": discord_username
+        }
+        
+        try:
+            response = await self._request("POST", "keys/claim", data, retries=1)
+            return response.get("key")
+        except APIError as e:
+            if e.status == 404:
+                return None
+            raise
+    
     async def get_stats(self) -> Dict[str, Any]:
         """
         Get key statistics.
@@ -271,12 +271,8 @@ async def setup(bot: commands.Bot) -> None:
         await interaction.response.defer(ephemeral=True)
         
         try:
-            # Get all keys
-            keys_response = await api.get_all_keys()
-            all_keys = keys_response.get("keys", [])
-            
-            # Find the key by value
-            key = next((k for k in all_keys if k.get("value") == key_value), None)
+            # Look up the key by value
+            key = await api.get_key_by_value(key_value)
             
             if not key:
                 await interaction.followup.send(
@@ -285,7 +281,6 @@ async def setup(bot: commands.Bot) -> None:
                 )
                 return
             
-            key_id = key.get("id")
             is_used = key.get("used", False)
             username = key.get("discordUsername", "")
             
@@ -297,7 +292,7 @@ async def setup(bot: commands.Bot) -> None:
                 return
             
             # Unassign the key
-            success = await api.mark_key_as_unused(key_id)
+            success = await api.mark_key_as_unused_by_value(key_value)
             
             if success:
                 await interaction.followup.send(
@@ -392,12 +387,8 @@ async def setup(bot: commands.Bot) -> None:
         await interaction.response.defer(ephemeral=True)
         
         try:
-            # Get all keys
-            keys_response = await api.get_all_keys()
-            all_keys = keys_response.get("keys", [])
-            
-            # Find the key by value
-            key = next((k for k in all_keys if k.get("value") == key_value), None)
+            # Look up the key by value
+            key = await api.get_key_by_value(key_value)
             
             if not key:
                 await interaction.followup.send(
@@ -406,7 +397,6 @@ async def setup(bot: commands.Bot) -> None:
                 )
                 return
             
-            key_id = key.get("id")
             is_used = key.get("used", False)
             username = key.get("discordUsername", "")
             
@@ -418,7 +408,7 @@ async def setup(bot: commands.Bot) -> None:
                 return
             
             # Unassign the key
-            success = await api.mark_key_as_unused(key_id)
+            success = await api.mark_key_as_unused_by_value(key_value)
             
             if success:
                 await interaction.followup.send(
@@ -5,7 +5,7 @@ import discord
 from discord import app_commands
 from discord.ext import commands
 import logging
-from api.client import KeyManagementAPI
+from api.client import KeyManagementAPI, APIError
 from utils.webhook import send_notification
 from utils.cache import get_cache, update_cache
 
@@ -101,66 +101,53 @@ async def setup(bot: commands.Bot) -> None:
             return
         
         try:
-            # Get available keys by type
-            keys_response = await api.get_keys_by_type(key_type.value)
+            # Claim a key server-side; picking and marking it is a single atomic call
+            key = await api.claim_key(key_type.value, username)
             
-            # Filter unused keys
-            unused_keys = [k for k in keys_response.get("keys", []) if not k.get("used")]
-            
-            # Update cache with current availability
-            if bot.config.cache_enabled:
-                await update_cache(
-                    cache_key,
-                    {
-                        "available": len(unused_keys),
-                        "total": len(keys_response.get("keys", []))
-                    }
-                )
-            
-            if not unused_keys:
+            if key is None:
+                # Remember the empty stock so repeated requests skip the API
+                if bot.config.cache_enabled:
+                    await update_cache(cache_key, {"available": 0})
+                
                 await interaction.followup.send(
                     f"Sorry, there are no {key_type.name} keys available at the moment. Please contact an administrator.",
                     ephemeral=True
                 )
                 return
             
-            # Get the first available key
-            key = unused_keys[0]
-            key_id = key.get("id")
             key_value = key.get("value")
             
-            # Mark the key as used
-            success = await api.mark_key_as_used(key_id, username)
+            # Send the key to the user
+            embed = discord.Embed(
+                title=f"Your {key_type.name} Key",
+                description=f"Here is your requested license key:\n`{key_value}`",
+                color=discord.Color.green()
+            )
+            embed.add_field(name="Type", value=key_type.name, inline=True)
+            embed.add_field(name="User", value=username, inline=True)
+            embed.set_footer(text="Keep this key private and do not share it!")
+            
+            await interaction.followup.send(embed=embed, ephemeral=True)
+            
+            # Log key assignment
+            logger.info(f"Key {key_value} ({key_type.name}) assigned to {username}")
             
-            if success:
-                # Send the key to the user
-                embed = discord.Embed(
-                    title=f"Your {key_type.name} Key",
-                    description=f"Here is your requested license key:\n`{key_value}`",
-                    color=discord.Color.green()
+            # Send notification via webhook if configured
+            if bot.config.notification_webhook_url:
+                await send_notification(
+                    webhook_url=bot.config.notification_webhook_url,
+                    title="Key Assigned",
+                    description=f"A {key_type.name} key was assigned to {username}",
+                    color=0x3498db  # Blue
                 )
-                embed.add_field(name="Type", value=key_type.name, inline=True)
-                embed.add_field(name="User", value=username, inline=True)
-                embed.set_footer(text="Keep this key private and do not share it!")
-                
-                await interaction.followup.send(embed=embed, ephemeral=True)
-                
-                # Log key assignment
-                logger.info(f"Key {key_value} ({key_type.name}) assigned to {username}")
-                
-                # Send notification via webhook if configured
-                if bot.config.notification_webhook_url:
-                    await send_notification(
-                        webhook_url=bot.config.notification_webhook_url,
-                        title="Key Assigned",
-                        description=f"A {key_type.name} key was assigned to {username}",
-                        color=0x3498db  # Blue
-                    )
+        except APIError as e:
+            logger.error(f"Error claiming key for {username}: {str(e)}")
+            if e.status == 0:
+                # The claim may have gone through before the connection failed
+                message = "The key server did not respond, so your key may already have been assigned. Please contact an administrator instead of retrying."
             else:
-                await interaction.followup.send(
-                    "There was an error assigning your key. Please try again later or contact an administrator.",
-                    ephemeral=True
-                )
+                message = "There was an error processing your request. Please try again later."
+            await interaction.followup.send(message, ephemeral=True)
         except Exception as e:
             logger.error(f"Error in getkey command: {str(e)}")
             await interaction.followup.send(
@@ -187,12 +174,8 @@ async def setup(bot: commands.Bot) -> None:
         await interaction.response.defer(ephemeral=True)
         
         try:
-            # Get all keys
-            keys_response = await api.get_all_keys()
-            all_keys = keys_response.get("keys", [])
-            
-            # Find the matching key
-            matching_key = next((k for k in all_keys if k.get("value") == key), None)
+            # Look up the key by value
+            matching_key = await api.get_key_by_value(key)
             
             if not matching_key:
                 await interaction.followup.send(
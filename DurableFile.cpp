@@ -0,0 +1,87 @@
+#include "DurableFile.h"
+#include "WindowsCompatibilityFix.h"
+#include <filesystem>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool DurableFile::syncFile(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    bool synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return synced;
+}
+
+bool DurableFile::syncParentDirectory(const std::string& path) {
+    return true;
+}
+
+bool DurableFile::replace(const std::string& tempPath, const std::string& path) {
+    if (!syncFile(tempPath)) {
+        std::cerr << "Error: Unable to sync " << tempPath << std::endl;
+        return false;
+    }
+
+    if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        std::cerr << "Error: Unable to replace " << path << ": error " << GetLastError() << std::endl;
+        return false;
+    }
+    return true;
+}
+#else
+bool DurableFile::syncFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+bool DurableFile::syncParentDirectory(const std::string& path) {
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    if (directory.empty()) {
+        directory = ".";
+    }
+
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+bool DurableFile::replace(const std::string& tempPath, const std::string& path) {
+    if (!syncFile(tempPath)) {
+        std::cerr << "Error: Unable to sync " << tempPath << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::cerr << "Error: Unable to replace " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    if (!syncParentDirectory(path)) {
+        std::cerr << "Error: Unable to sync the directory of " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+#endif
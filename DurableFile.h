@@ -0,0 +1,22 @@
+#ifndef DURABLEFILE_H
+#define DURABLEFILE_H
+
+#include <string>
+
+// fsync helpers for files that must survive a power loss, not just a crash
+class DurableFile {
+public:
+    // Flush a file's contents to disk (fsync, or FlushFileBuffers on Windows)
+    static bool syncFile(const std::string& path);
+
+    // Flush the directory holding path, so a rename or create in it is durable.
+    // A no-op on Windows, where MoveFileEx's write-through covers renames.
+    static bool syncParentDirectory(const std::string& path);
+
+    // Swap a fully written temporary file in for path: the temporary file is
+    // synced before the rename and the directory after it, so once this returns
+    // true path holds the new contents even after a power loss
+    static bool replace(const std::string& tempPath, const std::string& path);
+};
+
+#endif // DURABLEFILE_H
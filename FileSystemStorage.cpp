@@ -1,28 +1,38 @@
 #include "FileSystemStorage.h"
+#include "DurableFile.h"
+#include "MappedFile.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <filesystem>
 
 FileSystemStorage::FileSystemStorage(const std::string& path) : filePath(path) {}
 
 bool FileSystemStorage::saveKeys(const std::string& data) {
     try {
-        std::ofstream file(filePath);
+        // Write to a temporary file and swap it in, so a crash mid-write
+        // never leaves a truncated database behind
+        std::string tempPath = filePath + ".tmp";
+        std::ofstream file(tempPath);
         if (!file.is_open()) {
-            std::cerr << "Error: Unable to open file for writing: " << filePath << std::endl;
+            std::cerr << "Error: Unable to open file for writing: " << tempPath << std::endl;
             return false;
         }
         file << data;
         file.close();
 
         // Verify the file was written correctly
-        std::ifstream verifyFile(filePath);
-        if (!verifyFile.is_open()) {
-            std::cerr << "Error: Unable to verify file was written: " << filePath << std::endl;
+        if (file.fail()) {
+            std::cerr << "Error: Unable to verify file was written: " << tempPath << std::endl;
             return false;
         }
-        verifyFile.close();
 
+        // Synced before and after the rename, so callers may drop the journal it covers
+        if (!DurableFile::replace(tempPath, filePath)) {
+            return false;
+        }
+
+        bytesWritten += data.size();
         return true;
     }
     catch (const std::exception& e) {
@@ -86,6 +96,60 @@ std::string FileSystemStorage::loadKeys() {
     }
 }
 
+bool FileSystemStorage::loadCollection(KeyCollection& collection) {
+    try {
+        MappedFile file;
+        if (!file.open(filePath)) {
+            std::cerr << "Error: Unable to open file for reading: " << filePath << std::endl;
+            return false;
+        }
+
+        // Check for empty file
+        if (file.size() == 0) {
+            std::cerr << "Warning: File is empty: " << filePath << std::endl;
+            collection = KeyCollection();
+            return true;
+        }
+
+        collection = KeyCollection::deserialize(file.view());
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading from file: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error loading from file" << std::endl;
+        return false;
+    }
+}
+
+bool FileSystemStorage::loadRecords(const RecordVisitor& apply) {
+    try {
+        MappedFile file;
+        if (!file.open(filePath)) {
+            std::cerr << "Error: Unable to open file for reading: " << filePath << std::endl;
+            return false;
+        }
+
+        if (file.size() == 0) {
+            std::cerr << "Warning: File is empty: " << filePath << std::endl;
+            return true;
+        }
+
+        KeyCollection::parseRecords(file.view(), apply);
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading from file: " << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        std::cerr << "Unknown error loading from file" << std::endl;
+        return false;
+    }
+}
+
 bool FileSystemStorage::exists() {
     try {
         std::ifstream file(filePath);
@@ -101,4 +165,8 @@ bool FileSystemStorage::exists() {
         std::cerr << "Unknown error checking if file exists" << std::endl;
         return false;
     }
+}
+
+uint64_t FileSystemStorage::getBytesWritten() {
+    return bytesWritten;
 }
\ No newline at end of file
@@ -2,12 +2,15 @@
 #define FILESYSTEMSTORAGE_H
 
 #include "IKeyStorage.h"
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 // Class for local file system storage
 class FileSystemStorage : public IKeyStorage {
 private:
     std::string filePath;
+    std::atomic<uint64_t> bytesWritten{ 0 };
 
 public:
     FileSystemStorage(const std::string& path);
@@ -15,6 +18,12 @@ public:
     bool saveKeys(const std::string& data) override;
     std::string loadKeys() override;
     bool exists() override;
+
+    // Maps keys.csv and parses it in place instead of copying it into strings
+    bool loadCollection(KeyCollection& collection) override;
+    bool loadRecords(const RecordVisitor& apply) override;
+
+    uint64_t getBytesWritten() override;
 };
 
 #endif // FILESYSTEMSTORAGE_H
\ No newline at end of file
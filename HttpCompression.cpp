@@ -0,0 +1,102 @@
+#include "HttpCompression.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+
+// Quality of one Accept-Encoding entry, 1 when it has no q parameter
+static double qualityOf(std::string_view parameters) {
+    size_t pos = parameters.find("q=");
+    if (pos == std::string_view::npos) {
+        return 1.0;
+    }
+    return std::atof(std::string(parameters.substr(pos + 2)).c_str());
+}
+
+ContentEncoding HttpCompression::negotiate(std::string_view acceptEncoding) {
+    // Quality of gzip, deflate and "*"; -1 when not listed
+    double gzip = -1.0;
+    double deflate = -1.0;
+    double any = -1.0;
+
+    size_t pos = 0;
+    while (pos < acceptEncoding.size()) {
+        size_t end = acceptEncoding.find(',', pos);
+        if (end == std::string_view::npos) {
+            end = acceptEncoding.size();
+        }
+        std::string_view entry = acceptEncoding.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t semicolon = entry.find(';');
+        std::string_view parameters = semicolon != std::string_view::npos ? entry.substr(semicolon + 1) : std::string_view();
+        std::string_view coding = entry.substr(0, semicolon);
+        while (!coding.empty() && std::isspace(static_cast<unsigned char>(coding.front()))) coding.remove_prefix(1);
+        while (!coding.empty() && std::isspace(static_cast<unsigned char>(coding.back()))) coding.remove_suffix(1);
+
+        std::string name(coding);
+        std::transform(name.begin(), name.end(), name.begin(),
+            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        double quality = qualityOf(parameters);
+        if (name == "gzip" || name == "x-gzip") {
+            gzip = quality;
+        }
+        else if (name == "deflate") {
+            deflate = quality;
+        }
+        else if (name == "*") {
+            any = quality;
+        }
+    }
+
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+
+    if (gzip > 0 && gzip >= deflate) {
+        return ContentEncoding::Gzip;
+    }
+    if (deflate > 0) {
+        return ContentEncoding::Deflate;
+    }
+    return ContentEncoding::Identity;
+}
+
+const char* HttpCompression::headerValue(ContentEncoding encoding) {
+    switch (encoding) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Deflate: return "deflate";
+    default: return "";
+    }
+}
+
+bool HttpCompression::compress(std::string_view body, ContentEncoding encoding, std::string& out) {
+    if (encoding == ContentEncoding::Identity) {
+        out.assign(body);
+        return true;
+    }
+
+    // A single deflate call takes at most 4 GiB
+    if (body.size() > UINT32_MAX) {
+        return false;
+    }
+
+    // Window bits 15 for the zlib format, plus 16 for a gzip header and trailer
+    z_stream stream{};
+    int windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    // deflateBound is an upper limit, so a single call compresses everything
+    out.resize(deflateBound(&stream, static_cast<uLong>(body.size())));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef HTTPCOMPRESSION_H
+#define HTTPCOMPRESSION_H
+
+#include <string>
+#include <string_view>
+
+// Content codings the API can send
+enum class ContentEncoding { Identity, Gzip, Deflate, Count };
+
+// Accept-Encoding negotiation and zlib compression of response bodies, kept free of Crow
+class HttpCompression {
+public:
+    // Bodies smaller than this are sent as they are by default
+    static constexpr size_t DEFAULT_MIN_BYTES = 1024;
+
+    // The coding to answer a request with: gzip if the client accepts it, else deflate,
+    // else identity. Codings with q=0 are refused; "*" stands for any coding not listed.
+    static ContentEncoding negotiate(std::string_view acceptEncoding);
+
+    // Content-Encoding header value of a coding ("gzip", "deflate", empty for identity)
+    static const char* headerValue(ContentEncoding encoding);
+
+    // Compress body into out ("deflate" is the zlib format, as HTTP defines it).
+    // Returns false, leaving out unspecified, if zlib fails.
+    static bool compress(std::string_view body, ContentEncoding encoding, std::string& out);
+};
+
+#endif // HTTPCOMPRESSION_H
\ No newline at end of file
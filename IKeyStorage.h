@@ -1,8 +1,33 @@
 #ifndef IKEYSTORAGE_H
 #define IKEYSTORAGE_H
 
+#include "KeyCollection.h"
+#include "KeySnapshot.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 
+// Group commit counters reported by journaling backends
+struct CommitStats {
+	static constexpr size_t HISTOGRAM_BUCKETS = 5;
+	static constexpr size_t HISTOGRAM_LIMITS[HISTOGRAM_BUCKETS] = { 1, 4, 16, 64, SIZE_MAX };
+
+	uint64_t batches = 0;
+	uint64_t records = 0;
+	uint64_t largestBatch = 0;
+	uint64_t failedBatches = 0;
+	uint64_t totalLatencyMicros = 0;
+	uint64_t maxLatencyMicros = 0;
+
+	// Batches with at most 1, 4, 16, 64 and any number of records
+	uint64_t batchSizeHistogram[HISTOGRAM_BUCKETS] = {};
+
+	// Current settings
+	uint64_t commitWindowMicros = 0;
+	uint64_t maxBatchSize = 0;
+};
+
 // Interface for key storage
 class IKeyStorage {
 public:
@@ -10,6 +35,74 @@ public:
 	virtual bool saveKeys(const std::string& data) = 0;
 	virtual std::string loadKeys() = 0;
 	virtual bool exists() = 0;
+
+	// Whole collection load/save. Backends that can do better than the
+	// serialized text round trip override these.
+	virtual bool loadCollection(KeyCollection& collection) {
+		collection = KeyCollection::deserialize(loadKeys());
+		return true;
+	}
+
+	// Hand every stored record to apply without building a collection, so the
+	// caller can put them straight into its own structures. Journaling backends
+	// follow the snapshot with their journal records, so a later record for a
+	// value updates the key rather than adding another (see applyRecord).
+	virtual bool loadRecords(const RecordVisitor& apply) {
+		KeyCollection::parseRecords(loadKeys(), apply);
+		return true;
+	}
+
+	virtual bool saveCollection(const KeyCollection& collection) {
+		return saveKeys(collection.serialize());
+	}
+
+	// Save a flat copy of the keys. Backends that write records directly
+	// override this instead of going through the text form.
+	virtual bool saveRecords(const KeySnapshot& snapshot) {
+		return saveKeys(snapshot.serialize());
+	}
+
+	// Save the keys returned by capture. Journaling backends start a new
+	// journal before calling it, so a change made while capture runs ends up in
+	// the snapshot or the new journal and is never dropped with the old one.
+	virtual bool saveSnapshot(const std::function<KeySnapshot()>& capture) {
+		return saveRecords(capture());
+	}
+
+	// Incremental persistence of a single mutated key. Returns a ticket for
+	// waitForCommit, or 0 if the backend cannot append records, in which case
+	// the caller falls back to saveCollection.
+	virtual uint64_t appendRecord(const KeyView& key) {
+		return 0;
+	}
+
+	// Block until the record with this ticket is durable. False if its write failed.
+	virtual bool waitForCommit(uint64_t ticket) {
+		return true;
+	}
+
+	// Block until every record appended so far is durable. False if a write failed.
+	virtual bool flush() {
+		return true;
+	}
+
+	// True once enough records were appended that the caller should fold
+	// them into a fresh snapshot with saveCollection
+	virtual bool checkpointDue() {
+		return false;
+	}
+
+	// Group commit tuning and counters, for backends that batch appends
+	virtual void configureGroupCommit(std::chrono::microseconds window, size_t maxBatchSize) {}
+
+	virtual bool getCommitStats(CommitStats& stats) {
+		return false;
+	}
+
+	// Total bytes written to the snapshot (keys.csv or keys.bin) since startup
+	virtual uint64_t getBytesWritten() {
+		return 0;
+	}
 };
 
 #endif // IKEYSTORAGE_H
\ No newline at end of file
@@ -0,0 +1,496 @@
+#include "JournaledStorage.h"
+#include "DurableFile.h"
+#include "WindowsCompatibilityFix.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+JournaledStorage::JournaledStorage(std::unique_ptr<IKeyStorage> snapshotStorage, const std::string& journalFile,
+    size_t checkpointEvery)
+    : snapshot(std::move(snapshotStorage)),
+    journalPath(journalFile),
+    rotatedJournalPath(journalFile + ".old"),
+    journalRecords(0),
+    checkpointThreshold(checkpointEvery),
+    journal(nullptr),
+    journalSize(0),
+    journalAvailable(false),
+    queuedCount(0),
+    lastTicket(0),
+    committedTicket(0),
+    commitWindow(DEFAULT_COMMIT_WINDOW),
+    maxBatchSize(DEFAULT_MAX_BATCH_SIZE),
+    stoppingCommits(false),
+    checkpointInProgress(false),
+    stopping(false) {
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        openJournal(false);
+    }
+    commitThread = std::thread(&JournaledStorage::commitLoop, this);
+    checkpointThread = std::thread(&JournaledStorage::checkpointLoop, this);
+}
+
+JournaledStorage::~JournaledStorage() {
+    // Commit everything still queued before the final checkpoint runs
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        stoppingCommits = true;
+    }
+    recordsQueued.notify_all();
+
+    if (commitThread.joinable()) {
+        commitThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        stopping = true;
+    }
+    checkpointChanged.notify_all();
+
+    // The loop finishes any pending checkpoint before it exits
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(journalMutex);
+    closeJournal();
+}
+
+// Caller holds journalMutex
+bool JournaledStorage::openJournal(bool truncate) {
+    closeJournal();
+
+    // Binary mode, so batches are written byte for byte on Windows too
+    journal = std::fopen(journalPath.c_str(), truncate ? "wb" : "ab");
+    if (!journal) {
+        std::cerr << "Error: Unable to open journal for writing: " << journalPath << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    journalSize = truncate ? 0 : std::filesystem::file_size(journalPath, ec);
+    if (ec) {
+        std::cerr << "Error: Unable to read journal size: " << journalPath << std::endl;
+        closeJournal();
+        return false;
+    }
+
+    journalAvailable = true;
+    return true;
+}
+
+// Caller holds journalMutex
+bool JournaledStorage::discardTornBatch() {
+    // Part of a failed batch may have reached the file. Appending the next batch
+    // right after it would merge the two into one corrupt record mid-journal,
+    // so cut the file back to the last good batch first.
+    closeJournal();
+
+    std::error_code ec;
+    std::filesystem::resize_file(journalPath, journalSize, ec);
+    if (ec) {
+        // Leave the journal closed; mutations fall back to full saves
+        std::cerr << "Error: Unable to truncate journal after a failed write: " << ec.message() << std::endl;
+        return false;
+    }
+    return openJournal(false);
+}
+
+// Caller holds journalMutex
+void JournaledStorage::closeJournal() {
+    journalAvailable = false;
+    if (journal) {
+        std::fclose(journal);
+        journal = nullptr;
+    }
+}
+
+// Caller holds checkpointMutex
+bool JournaledStorage::rotateJournal() {
+    // Records still queued for the commit thread land in the new journal. That
+    // is safe: the checkpoint already contains them and replay order is kept.
+    std::lock_guard<std::mutex> lock(journalMutex);
+    std::error_code ec;
+    closeJournal();
+
+    if (std::filesystem::exists(rotatedJournalPath, ec)) {
+        // A previous checkpoint failed, so keep its records ahead of the newer ones
+        std::ifstream current(journalPath, std::ios::binary);
+        std::ofstream rotated(rotatedJournalPath, std::ios::binary | std::ios::app);
+        if (!rotated.is_open()) {
+            std::cerr << "Error: Unable to append to journal: " << rotatedJournalPath << std::endl;
+            openJournal(false);
+            return false;
+        }
+        if (current.is_open() && current.peek() != std::ifstream::traits_type::eof()) {
+            rotated << current.rdbuf();
+        }
+        rotated.close();
+
+        // The live journal is truncated next, so its records must be safely in .old first
+        if (rotated.fail() || !DurableFile::syncFile(rotatedJournalPath)) {
+            std::cerr << "Error: Unable to append to journal: " << rotatedJournalPath << std::endl;
+            openJournal(false);
+            return false;
+        }
+    }
+    else if (std::filesystem::exists(journalPath, ec)) {
+        std::filesystem::rename(journalPath, rotatedJournalPath, ec);
+        if (ec || !DurableFile::syncParentDirectory(rotatedJournalPath)) {
+            std::cerr << "Error: Unable to rotate journal: " << (ec ? ec.message() : "directory sync failed") << std::endl;
+            openJournal(false);
+            return false;
+        }
+    }
+
+    journalRecords = 0;
+    return openJournal(true);
+}
+
+void JournaledStorage::commitLoop() {
+    std::unique_lock<std::mutex> lock(commitMutex);
+    std::string batch;
+
+    while (true) {
+        recordsQueued.wait(lock, [this]() { return queuedCount > 0 || stoppingCommits; });
+        if (queuedCount == 0) {
+            break;
+        }
+
+        // Give concurrent writers the rest of the window to join this batch
+        recordsQueued.wait_until(lock, firstQueuedAt + commitWindow,
+            [this]() { return queuedCount >= maxBatchSize || stoppingCommits; });
+
+        // Swap buffers so the next batch reuses this one's capacity
+        batch.clear();
+        batch.swap(queuedRecords);
+        size_t batchSize = queuedCount;
+        uint64_t batchLastTicket = lastTicket;
+        auto batchStartedAt = firstQueuedAt;
+        queuedCount = 0;
+        lock.unlock();
+
+        bool written = writeBatch(batch);
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - batchStartedAt).count();
+
+        lock.lock();
+        committedTicket = batchLastTicket;
+        if (!written) {
+            uint64_t batchFirstTicket = batchLastTicket - batchSize + 1;
+            auto previous = failedTickets.empty() ? failedTickets.end() : std::prev(failedTickets.end());
+            if (previous != failedTickets.end() && previous->second + 1 == batchFirstTicket) {
+                previous->second = batchLastTicket;
+            }
+            else {
+                failedTickets.emplace(batchFirstTicket, batchLastTicket);
+            }
+            commitStats.failedBatches++;
+        }
+
+        commitStats.batches++;
+        commitStats.records += batchSize;
+        commitStats.largestBatch = std::max<uint64_t>(commitStats.largestBatch, batchSize);
+        commitStats.totalLatencyMicros += latency;
+        commitStats.maxLatencyMicros = std::max<uint64_t>(commitStats.maxLatencyMicros, latency);
+        for (size_t i = 0; i < CommitStats::HISTOGRAM_BUCKETS; i++) {
+            if (batchSize <= CommitStats::HISTOGRAM_LIMITS[i]) {
+                commitStats.batchSizeHistogram[i]++;
+                break;
+            }
+        }
+
+        batchCommitted.notify_all();
+    }
+}
+
+bool JournaledStorage::writeBatch(const std::string& batch) {
+    std::lock_guard<std::mutex> lock(journalMutex);
+    if (!journal) {
+        std::cerr << "Error: Journal is not open: " << journalPath << std::endl;
+        return false;
+    }
+
+    // One write and one fsync for the whole batch
+    bool written = std::fwrite(batch.data(), 1, batch.size(), journal) == batch.size() &&
+        std::fflush(journal) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(journal)) == 0;
+#else
+    written = written && fsync(fileno(journal)) == 0;
+#endif
+
+    if (!written) {
+        std::cerr << "Error: Failed to append to journal: " << journalPath << std::endl;
+        discardTornBatch();
+        return false;
+    }
+
+    journalSize += batch.size();
+    return true;
+}
+
+void JournaledStorage::waitForCheckpoint(std::unique_lock<std::mutex>& lock) {
+    checkpointChanged.wait(lock, [this]() { return !checkpointInProgress; });
+}
+
+void JournaledStorage::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+
+    while (true) {
+        checkpointChanged.wait(lock, [this]() { return pendingCheckpoint || stopping; });
+        if (!pendingCheckpoint) {
+            break;
+        }
+
+        std::shared_ptr<const KeySnapshot> keys = std::move(pendingCheckpoint);
+        pendingCheckpoint.reset();
+        lock.unlock();
+
+        // Snapshot first, then drop the records it now contains. saveRecords
+        // only succeeds once the snapshot is synced to disk. A crash in between
+        // only means those records are replayed again, which is harmless because
+        // every record carries the key's full state.
+        if (snapshot->saveRecords(*keys)) {
+            std::error_code ec;
+            std::filesystem::remove(rotatedJournalPath, ec);
+        }
+        else {
+            std::cerr << "Error: Checkpoint failed, journal kept for replay." << std::endl;
+        }
+        keys.reset();
+
+        lock.lock();
+        checkpointInProgress = false;
+        checkpointChanged.notify_all();
+    }
+}
+
+bool JournaledStorage::saveKeys(const std::string& data) {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    waitForCheckpoint(lock);
+
+    // Full synchronous rewrite: the snapshot then holds everything
+    if (!snapshot->saveKeys(data)) {
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(rotatedJournalPath, ec);
+    journalRecords = 0;
+
+    std::lock_guard<std::mutex> journalLock(journalMutex);
+    return openJournal(true);
+}
+
+std::string JournaledStorage::loadKeys() {
+    KeyCollection collection;
+    if (!loadCollection(collection)) {
+        return "";
+    }
+    return collection.serialize();
+}
+
+bool JournaledStorage::exists() {
+    std::error_code ec;
+    if (snapshot->exists() || std::filesystem::exists(rotatedJournalPath, ec)) {
+        return true;
+    }
+
+    // The journal is created empty on startup, so only count it when it holds records
+    return std::filesystem::exists(journalPath, ec) && std::filesystem::file_size(journalPath, ec) > 0;
+}
+
+bool JournaledStorage::loadCollection(KeyCollection& collection) {
+    // Records still queued would otherwise be missing from the replay
+    flush();
+
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    waitForCheckpoint(lock);
+
+    if (snapshot->exists()) {
+        if (!snapshot->loadCollection(collection)) {
+            return false;
+        }
+    }
+    else {
+        collection = KeyCollection();
+    }
+
+    auto apply = [&collection](const KeyView& key) { collection.applyRecord(key); };
+    size_t replayed = replayJournal(rotatedJournalPath, apply);
+    replayed += replayJournal(journalPath, apply);
+    journalRecords = replayed;
+
+    if (replayed > 0) {
+        std::cout << "Replayed " << replayed << " journal records." << std::endl;
+    }
+    return true;
+}
+
+bool JournaledStorage::loadRecords(const RecordVisitor& apply) {
+    // Records still queued would otherwise be missing from the replay
+    flush();
+
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    waitForCheckpoint(lock);
+
+    if (snapshot->exists() && !snapshot->loadRecords(apply)) {
+        return false;
+    }
+
+    size_t replayed = replayJournal(rotatedJournalPath, apply);
+    replayed += replayJournal(journalPath, apply);
+    journalRecords = replayed;
+
+    if (replayed > 0) {
+        std::cout << "Replayed " << replayed << " journal records." << std::endl;
+    }
+    return true;
+}
+
+bool JournaledStorage::saveCollection(const KeyCollection& collection) {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    waitForCheckpoint(lock);
+
+    if (!rotateJournal()) {
+        // Could not start a new journal, so fall back to a synchronous rewrite
+        lock.unlock();
+        return saveKeys(collection.serialize());
+    }
+
+    // The checkpoint thread writes a private flat copy, so callers keep mutating freely
+    pendingCheckpoint = std::make_shared<const KeySnapshot>(collection);
+    checkpointInProgress = true;
+    checkpointChanged.notify_all();
+    return true;
+}
+
+bool JournaledStorage::saveSnapshot(const std::function<KeySnapshot()>& capture) {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    waitForCheckpoint(lock);
+
+    if (!rotateJournal()) {
+        lock.unlock();
+        return saveKeys(capture().serialize());
+    }
+
+    // Records appended from here on go to the new journal, so capturing only now
+    // loses nothing, and the capture is handed over without another copy
+    pendingCheckpoint = std::make_shared<const KeySnapshot>(capture());
+    checkpointInProgress = true;
+    checkpointChanged.notify_all();
+    return true;
+}
+
+uint64_t JournaledStorage::appendRecord(const KeyView& key) {
+    if (!journalAvailable) {
+        return 0;
+    }
+
+    // Serialize outside the lock so writers only contend on the queue append
+    std::string record = key.serialize();
+    record += '\n';
+
+    std::lock_guard<std::mutex> lock(commitMutex);
+    if (stoppingCommits) {
+        return 0;
+    }
+
+    if (queuedCount == 0) {
+        firstQueuedAt = std::chrono::steady_clock::now();
+    }
+    queuedRecords += record;
+    queuedCount++;
+    journalRecords++;
+
+    // Wake the commit thread to open a window, or to close it early when full
+    if (queuedCount == 1 || queuedCount >= maxBatchSize) {
+        recordsQueued.notify_one();
+    }
+    return ++lastTicket;
+}
+
+bool JournaledStorage::waitForCommit(uint64_t ticket) {
+    if (ticket == 0) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(commitMutex);
+    batchCommitted.wait(lock, [this, ticket]() { return committedTicket >= ticket; });
+
+    // The last range starting at or before the ticket is the only one that can hold it
+    auto failed = failedTickets.upper_bound(ticket);
+    if (failed == failedTickets.begin()) {
+        return true;
+    }
+    return std::prev(failed)->second < ticket;
+}
+
+bool JournaledStorage::flush() {
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        ticket = lastTicket;
+    }
+    return waitForCommit(ticket);
+}
+
+bool JournaledStorage::checkpointDue() {
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    return !checkpointInProgress && journalRecords >= checkpointThreshold;
+}
+
+void JournaledStorage::configureGroupCommit(std::chrono::microseconds window, size_t maxBatch) {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    commitWindow = std::max(window, std::chrono::microseconds(0));
+    maxBatchSize = std::max<size_t>(maxBatch, 1);
+}
+
+bool JournaledStorage::getCommitStats(CommitStats& stats) {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    stats = commitStats;
+    stats.commitWindowMicros = commitWindow.count();
+    stats.maxBatchSize = maxBatchSize;
+    return true;
+}
+
+size_t JournaledStorage::replayJournal(const std::string& path, const RecordVisitor& apply) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return 0;
+    }
+
+    size_t replayed = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        // A record without its newline was torn by a crash mid-append
+        if (file.eof()) {
+            std::cerr << "Warning: Ignoring incomplete journal record in " << path << std::endl;
+            break;
+        }
+
+        if (line.empty()) {
+            continue;
+        }
+
+        apply(KeyView::deserialize(line, '|'));
+        replayed++;
+    }
+
+    return replayed;
+}
+
+uint64_t JournaledStorage::getBytesWritten() {
+    return snapshot->getBytesWritten();
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef JOURNALEDSTORAGE_H
+#define JOURNALEDSTORAGE_H
+
+#include "IKeyStorage.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Write-ahead journal on top of a snapshot storage backend.
+// Every mutation appends the key's serialized line to the journal instead of
+// rewriting the whole snapshot. Loading replays snapshot plus journal, and a
+// background thread folds the journal into a fresh snapshot (checkpoint).
+//
+// Appends are group committed: records queue up for a short window (or until
+// the batch is full) and a commit thread writes and fsyncs them together.
+// appendRecord returns a ticket and waitForCommit blocks until that record's
+// batch is durable, so callers can release their own locks before waiting.
+class JournaledStorage : public IKeyStorage {
+private:
+    std::unique_ptr<IKeyStorage> snapshot;
+    std::string journalPath;
+    std::string rotatedJournalPath;
+    std::atomic<size_t> journalRecords;
+    size_t checkpointThreshold;
+
+    // Journal file; the commit thread writes it and rotation swaps it
+    std::mutex journalMutex;
+    FILE* journal;
+    uint64_t journalSize;  // Bytes up to the end of the last good batch
+    std::atomic<bool> journalAvailable;
+
+    // Group commit state
+    std::mutex commitMutex;
+    std::condition_variable recordsQueued;
+    std::condition_variable batchCommitted;
+    std::thread commitThread;
+    std::string queuedRecords;
+    size_t queuedCount;
+    uint64_t lastTicket;
+    uint64_t committedTicket;
+    // Ticket ranges of failed batches, first to last. Adjacent ranges are merged
+    // and none are dropped, so a waiter learns of its failure however late it wakes.
+    std::map<uint64_t, uint64_t> failedTickets;
+    std::chrono::steady_clock::time_point firstQueuedAt;
+    std::chrono::microseconds commitWindow;
+    size_t maxBatchSize;
+    CommitStats commitStats;
+    bool stoppingCommits;
+
+    // Background checkpoint state
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointChanged;
+    std::thread checkpointThread;
+    std::shared_ptr<const KeySnapshot> pendingCheckpoint;
+    std::atomic<bool> checkpointInProgress;  // Read by checkpointDue without checkpointMutex
+    bool stopping;
+
+    void commitLoop();
+    bool writeBatch(const std::string& batch);
+    void checkpointLoop();
+    void waitForCheckpoint(std::unique_lock<std::mutex>& lock);
+    bool openJournal(bool truncate);
+    void closeJournal();
+    bool discardTornBatch();
+    bool rotateJournal();
+
+public:
+    static constexpr std::chrono::microseconds DEFAULT_COMMIT_WINDOW{ 2000 };
+    static constexpr size_t DEFAULT_MAX_BATCH_SIZE = 256;
+
+    JournaledStorage(std::unique_ptr<IKeyStorage> snapshotStorage, const std::string& journalFile,
+        size_t checkpointEvery = 10000);
+    ~JournaledStorage();
+
+    bool saveKeys(const std::string& data) override;
+    std::string loadKeys() override;
+    bool exists() override;
+
+    bool loadCollection(KeyCollection& collection) override;
+    bool loadRecords(const RecordVisitor& apply) override;
+    bool saveCollection(const KeyCollection& collection) override;
+    bool saveSnapshot(const std::function<KeySnapshot()>& capture) override;
+    uint64_t appendRecord(const KeyView& key) override;
+    bool waitForCommit(uint64_t ticket) override;
+    bool flush() override;
+    bool checkpointDue() override;
+
+    // A batch is committed once the window since its first record has passed,
+    // or as soon as maxBatchSize records are queued
+    void configureGroupCommit(std::chrono::microseconds window, size_t maxBatchSize) override;
+    bool getCommitStats(CommitStats& stats) override;
+
+    // Bytes written by the snapshot storage, checkpoints included
+    uint64_t getBytesWritten() override;
+
+    // Hand the records of a journal file to apply, oldest first.
+    // Returns the number of records replayed.
+    static size_t replayJournal(const std::string& path, const RecordVisitor& apply);
+};
+
+#endif // JOURNALEDSTORAGE_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "JsonRenderer.h"
+#include "KeyManager.h"
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+
+void JsonRenderer::appendEscaped(std::string& out, std::string_view value) {
+    // Most values need no escaping, so scan first and copy in one go
+    auto needsEscape = [](unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; };
+    if (std::none_of(value.begin(), value.end(), needsEscape)) {
+        out += value;
+        return;
+    }
+
+    static const char hexDigits[] = "0123456789abcdef";
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += hexDigits[c >> 4];
+                out += hexDigits[c & 0x0F];
+            }
+            else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+}
+
+void JsonRenderer::appendKey(std::string& out, size_t id, const KeyView& key) {
+    out += R"({"id":)";
+    out += std::to_string(id);
+    out += R"(,"value":")";
+    appendEscaped(out, key.getKeyValue());
+    out += R"(","type":)";
+    out += std::to_string(static_cast<int>(key.getKeyType()));
+    out += R"(,"typeName":")";
+    out += key.getKeyTypeName();
+    out += R"(","used":)";
+    out += key.getIsUsed() ? "true" : "false";
+    out += R"(,"discordUsername":")";
+    appendEscaped(out, key.getDiscordUsername());
+    out += R"("})";
+}
+
+std::string JsonRenderer::renderUserKeys(const KeyManager& keyManager, const std::string& username, bool substring) {
+    std::string body;
+    body += R"({"keys":[)";
+    bool first = true;
+    keyManager.forEachKeyOfUser(username, substring, [&body, &first](size_t id, const KeyView& key) {
+        if (!first) body += ',';
+        first = false;
+        appendKey(body, id, key);
+    });
+    body += "]}";
+    return body;
+}
+
+std::string JsonRenderer::renderKeyList(const KeyManager& keyManager, std::optional<KeyType> keyType,
+    size_t cursor, std::optional<size_t> limit) {
+    // Keys are rendered straight from the collection, a page per acquisition of the read
+    // locks, so a full list never holds off writers for the whole body
+    const size_t STREAM_PAGE_SIZE = 1024;
+
+    KeyFilter filter;
+    filter.type = keyType;
+    std::string body;
+    body.reserve(limit ? *limit * 128 : STREAM_PAGE_SIZE * 128);
+    body += R"({"keys":[)";
+
+    bool first = true;
+    size_t remaining = limit ? *limit : SIZE_MAX;
+    size_t nextCursor = cursor;
+
+    while (nextCursor != KeyCollection::npos && remaining > 0) {
+        size_t rendered = 0;
+        nextCursor = keyManager.forEachKeyPage(nextCursor, std::min(remaining, STREAM_PAGE_SIZE), filter,
+            [&body, &first, &rendered](size_t id, const KeyView& key) {
+                if (!first) body += ',';
+                first = false;
+                appendKey(body, id, key);
+                rendered++;
+            });
+        remaining -= rendered;
+    }
+
+    body += ']';
+    if (limit) {
+        body += R"(,"nextCursor":)";
+        body += nextCursor != KeyCollection::npos ? std::to_string(nextCursor) : "null";
+    }
+    body += '}';
+
+    return body;
+}
+
+std::string JsonRenderer::renderStats(const KeyStats& stats) {
+    std::stringstream json;
+    json << R"({)";
+    json << R"("totalKeys":)" << stats.totalKeys() << R"(,)";
+    json << R"("usedKeys":)" << stats.usedKeys() << R"(,)";
+    json << R"("availableKeys":)" << stats.availableKeys() << R"(,)";
+
+    json << R"("keysByType":{)";
+
+    bool first = true;
+    for (int i = 0; i <= 3; i++) {
+        KeyType type = static_cast<KeyType>(i);
+        std::string typeName;
+
+        switch (type) {
+        case KeyType::Day: typeName = "Daily"; break;
+        case KeyType::Week: typeName = "Weekly"; break;
+        case KeyType::Month: typeName = "Monthly"; break;
+        case KeyType::Lifetime: typeName = "Lifetime"; break;
+        }
+
+        if (!first) json << R"(,)";
+        first = false;
+
+        json << R"(")" << typeName << R"(":{)";
+        json << R"("total":)" << stats.totalOf(type) << R"(,)";
+        json << R"("used":)" << stats.usedOf(type) << R"(,)";
+        json << R"("available":)" << stats.availableOf(type);
+        json << R"(})";
+    }
+
+    json << R"(})";
+    json << R"(})";
+
+    return json.str();
+}
+
+std::string JsonRenderer::renderChanges(uint64_t epoch, uint64_t version, const std::vector<ChangeFeed::Change>& changes) {
+    std::string body;
+    body.reserve(changes.size() * 128 + 64);
+    body += R"({"epoch":)";
+    body += std::to_string(epoch);
+    body += R"(,"version":)";
+    body += std::to_string(version);
+    body += R"(,"changes":[)";
+    for (size_t i = 0; i < changes.size(); i++) {
+        const ChangeFeed::Change& change = changes[i];
+        if (i > 0) {
+            body += ',';
+        }
+
+        body += R"({"version":)";
+        body += std::to_string(change.version);
+        switch (change.kind) {
+        case ChangeFeed::Kind::Added: body += R"(,"change":"added")"; break;
+        case ChangeFeed::Kind::Used: body += R"(,"change":"used")"; break;
+        case ChangeFeed::Kind::Unused: body += R"(,"change":"unused")"; break;
+        }
+        body += R"(,"value":")";
+        appendEscaped(body, change.keyValue);
+        body += R"(","type":)";
+        body += std::to_string(static_cast<int>(change.keyType));
+        body += R"(,"typeName":")";
+        body += Key::typeName(change.keyType);
+        body += R"(","discordUsername":")";
+        appendEscaped(body, change.discordUsername);
+        body += R"("})";
+    }
+    body += "]}";
+    return body;
+}
\ No newline at end of file
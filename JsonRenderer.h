@@ -0,0 +1,38 @@
+#ifndef JSONRENDERER_H
+#define JSONRENDERER_H
+
+#include "ChangeFeed.h"
+#include "KeyCollection.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class KeyManager;
+
+// JSON bodies of the API responses, kept free of Crow so they can be benchmarked
+class JsonRenderer {
+public:
+    // Append a string as JSON string content
+    static void appendEscaped(std::string& out, std::string_view value);
+
+    // Append one key object as rendered by the key list routes
+    static void appendKey(std::string& out, size_t id, const KeyView& key);
+
+    // Body of /api/users/<string>/keys: {"keys":[...]} for the keys held by a username
+    static std::string renderUserKeys(const KeyManager& keyManager, const std::string& username, bool substring);
+
+    // Body of /api/keys and /api/keys/type/<int>. Without a limit every key from
+    // cursor on is rendered; with one, a page and its "nextCursor" are.
+    static std::string renderKeyList(const KeyManager& keyManager, std::optional<KeyType> keyType,
+        size_t cursor, std::optional<size_t> limit);
+
+    // Body of /api/stats
+    static std::string renderStats(const KeyStats& stats);
+
+    // Body of /api/changes: the changes in order and the version to ask for next
+    static std::string renderChanges(uint64_t epoch, uint64_t version, const std::vector<ChangeFeed::Change>& changes);
+};
+
+#endif // JSONRENDERER_H
\ No newline at end of file
@@ -1,28 +1,44 @@
 #include "Key.h"
-#include <sstream>
+#include <cstring>
 
-Key::Key(const std::string& key, KeyType type, bool used, const std::string& username)
-    : keyValue(key), keyType(type), isUsed(used), discordUsername(username) {
+Key::Key(std::string key, KeyType type, bool used, std::string username)
+    : keyValue(std::move(key)), discordUsername(std::move(username)), state(packState(type, used)) {
 }
 
-std::string Key::getKeyValue() const {
+Key::Key(const KeyView& view)
+    : keyValue(view.getKeyValue()), discordUsername(view.getDiscordUsername()), id(view.getId()), state(view.getState()) {
+}
+
+std::string_view Key::getKeyValue() const {
     return keyValue;
 }
 
 bool Key::getIsUsed() const {
-    return isUsed;
+    return (state & USED_FLAG) != 0;
 }
 
-std::string Key::getDiscordUsername() const {
+std::string_view Key::getDiscordUsername() const {
     return discordUsername;
 }
 
 KeyType Key::getKeyType() const {
-    return keyType;
+    return static_cast<KeyType>(state & TYPE_MASK);
+}
+
+std::string_view Key::getKeyTypeName() const {
+    return typeName(getKeyType());
 }
 
-std::string Key::getKeyTypeName() const {
-    switch (keyType) {
+uint8_t Key::getState() const {
+    return state;
+}
+
+uint64_t Key::getId() const {
+    return id;
+}
+
+std::string_view Key::typeName(KeyType type) {
+    switch (type) {
     case KeyType::Day:
         return "Daily";
     case KeyType::Week:
@@ -37,107 +53,179 @@ std::string Key::getKeyTypeName() const {
 }
 
 void Key::setIsUsed(bool used) {
-    isUsed = used;
+    state = packState(getKeyType(), used);
 }
 
-void Key::setDiscordUsername(const std::string& username) {
-    discordUsername = username;
+void Key::setDiscordUsername(std::string username) {
+    discordUsername = std::move(username);
 }
 
 void Key::setKeyType(KeyType type) {
-    keyType = type;
+    state = packState(type, getIsUsed());
+}
+
+void Key::setId(uint64_t keyId) {
+    id = keyId;
 }
 
 std::string Key::serialize() const {
-    // Format: keyValue|typeValue|isUsed|discordUsername
-    // Using | as separator instead of comma to avoid issues with usernames containing commas
-    return keyValue + "|" +
-        std::to_string(static_cast<int>(keyType)) + "|" +
-        (isUsed ? "1" : "0") + "|" +
-        discordUsername;
+    return KeyView(*this).serialize();
 }
 
-Key Key::deserialize(const std::string& serialized) {
-    // Default values
-    std::string key = "";
-    KeyType type = KeyType::Day;
-    bool used = false;
-    std::string username = "";
+KeyView::KeyView(std::string_view key, uint8_t packedState, std::string_view username, uint64_t keyId)
+    : keyValue(key), discordUsername(username), id(keyId), state(packedState) {
+}
 
-    try {
-        // Check for empty input
-        if (serialized.empty()) {
-            return Key(key, type, used, username);
-        }
+KeyView::KeyView(const Key& key)
+    : keyValue(key.keyValue), discordUsername(key.discordUsername), id(key.id), state(key.state) {
+}
 
-        // First try to parse with the pipe separator (new format)
-        if (deserializeWithSeparator(serialized, '|', key, type, used, username)) {
-            return Key(key, type, used, username);
-        }
+bool KeyView::getIsUsed() const {
+    return (state & Key::USED_FLAG) != 0;
+}
 
-        // If that fails, try with comma separator (old format)
-        if (deserializeWithSeparator(serialized, ',', key, type, used, username)) {
-            return Key(key, type, used, username);
-        }
+KeyType KeyView::getKeyType() const {
+    return static_cast<KeyType>(state & Key::TYPE_MASK);
+}
 
-        // If both formats fail but we have a non-empty string, at least save the key value
-        if (!serialized.empty()) {
-            key = serialized;
-        }
+std::string_view KeyView::getKeyTypeName() const {
+    return Key::typeName(getKeyType());
+}
+
+std::string KeyView::serialize() const {
+    std::string out;
+    out.reserve(keyValue.size() + discordUsername.size() + 26);
+    serializeTo(out);
+    return out;
+}
+
+void KeyView::serializeTo(std::string& out) const {
+    // Format: keyValue|typeValue|isUsed|discordUsername|id
+    // Using | as separator instead of comma to avoid issues with usernames containing commas
+    out += keyValue;
+    out += '|';
+    out += static_cast<char>('0' + static_cast<int>(getKeyType()));
+    out += '|';
+    out += getIsUsed() ? '1' : '0';
+    out += '|';
+    out += discordUsername;
+    if (id != NO_KEY_ID) {
+        char digits[20];
+        char* start = digits + sizeof(digits);
+        uint64_t remaining = id;
+        do {
+            *--start = static_cast<char>('0' + remaining % 10);
+            remaining /= 10;
+        } while (remaining != 0);
+
+        out += '|';
+        out.append(start, digits + sizeof(digits) - start);
     }
-    catch (...) {
-        // If any exception occurs, return a key with default values except for the key string
-        if (key.empty() && !serialized.empty()) {
-            // Try to extract at least the key value
-            size_t separatorPos = serialized.find_first_of(",|");
-            if (separatorPos != std::string::npos) {
-                key = serialized.substr(0, separatorPos);
-            }
-            else {
-                key = serialized;
+}
+
+char Key::detectSeparator(std::string_view serialized) {
+    // The first non-empty line decides; bare key lists parse the same either way
+    size_t lineStart = 0;
+    while (lineStart < serialized.size()) {
+        size_t lineEnd = serialized.find('\n', lineStart);
+        if (lineEnd == std::string_view::npos) {
+            lineEnd = serialized.size();
+        }
+
+        std::string_view line = serialized.substr(lineStart, lineEnd - lineStart);
+        if (!line.empty() && line != "\r") {
+            if (line.find('|') == std::string_view::npos && line.find(',') != std::string_view::npos) {
+                return ',';
             }
+            return '|';
         }
+
+        lineStart = lineEnd + 1;
     }
 
-    return Key(key, type, used, username);
+    return '|';
+}
+
+Key Key::deserialize(std::string_view serialized) {
+    return deserialize(serialized, detectSeparator(serialized));
 }
 
-// Helper method to try parsing with a specific separator
-bool Key::deserializeWithSeparator(const std::string& serialized, char separator,
-    std::string& key, KeyType& type,
-    bool& used, std::string& username) {
-    std::stringstream ss(serialized);
-    std::string typeStr, usedStr;
+KeyView KeyView::deserialize(std::string_view serialized, char separator) {
+    // Format: keyValue|typeValue|isUsed|discordUsername|id, every field after the key optional
+    const char* cursor = serialized.data();
+    const char* end = cursor + serialized.size();
 
-    // Get the key value
-    if (!std::getline(ss, key, separator)) {
-        return false;
+    auto nextField = [&cursor, end, separator]() {
+        const char* fieldEnd = static_cast<const char*>(std::memchr(cursor, separator, end - cursor));
+        if (fieldEnd == nullptr) {
+            fieldEnd = end;
+        }
+        std::string_view field(cursor, fieldEnd - cursor);
+        cursor = fieldEnd < end ? fieldEnd + 1 : end;
+        return field;
+    };
+
+    if (serialized.empty()) {
+        return KeyView(std::string_view(), 0, std::string_view());
     }
 
-    // Try to get the type (optional)
-    if (std::getline(ss, typeStr, separator)) {
-        try {
-            // Only convert if the string contains digits
-            if (std::all_of(typeStr.begin(), typeStr.end(), [](char c) { return std::isdigit(c); })) {
-                int typeInt = std::stoi(typeStr);
-                // Validate range
-                if (typeInt >= 0 && typeInt <= 3) {
-                    type = static_cast<KeyType>(typeInt);
+    std::string_view key = nextField();
+    KeyType type = KeyType::Day;
+    bool used = false;
+    std::string_view username;
+    uint64_t id = NO_KEY_ID;
+
+    // Type and status are only present if the separator was
+    if (key.size() < serialized.size()) {
+        type = Key::parseKeyType(nextField());
+
+        if (cursor != end) {
+            used = (nextField() == "1");
+
+            // Username is the remainder of the line, separators included, up to a trailing
+            // all-digit id field. Legacy comma files never had ids.
+            username = std::string_view(cursor, end - cursor);
+            size_t idSeparator = username.rfind('|');
+            if (separator == '|' && idSeparator != std::string_view::npos) {
+                id = parseId(username.substr(idSeparator + 1));
+                if (id != NO_KEY_ID) {
+                    username = username.substr(0, idSeparator);
                 }
             }
         }
-        catch (...) {
-            // Ignore conversion errors, keep default
-        }
+    }
+
+    return KeyView(key, Key::packState(type, used), username, id);
+}
+
+Key Key::deserialize(std::string_view serialized, char separator) {
+    return Key(KeyView::deserialize(serialized, separator));
+}
 
-        // Try to get the used status (optional)
-        if (std::getline(ss, usedStr, separator)) {
-            used = (usedStr == "1");
+uint64_t KeyView::parseId(std::string_view idStr) {
+    if (idStr.empty() || idStr.size() > 19) {
+        return NO_KEY_ID;
+    }
 
-            // Get username (remainder of the string)
-            std::getline(ss, username);
+    uint64_t id = 0;
+    for (char c : idStr) {
+        if (c < '0' || c > '9') {
+            return NO_KEY_ID;
         }
+        id = id * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return id;
+}
+
+KeyType Key::parseKeyType(std::string_view typeStr) {
+    // Anything else keeps the default, as the old stoi based parser did
+    size_t digit = 0;
+    while (digit + 1 < typeStr.size() && typeStr[digit] == '0') {
+        digit++;
     }
 
-    return true;
+    if (digit + 1 == typeStr.size() && typeStr[digit] >= '0' && typeStr[digit] <= '3') {
+        return static_cast<KeyType>(typeStr[digit] - '0');
+    }
+    return KeyType::Day;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef KEY_H
 #define KEY_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <algorithm>
 
 // Enum for key subscription types
@@ -12,39 +14,101 @@ enum class KeyType {
     Lifetime
 };
 
+class Key;
+
+// Id of a key that has not been given one yet (e.g. read from a file older than key ids)
+constexpr uint64_t NO_KEY_ID = UINT64_MAX;
+
+// Non-owning view of a key, e.g. one stored in a KeyCollection.
+// Only valid until the storage it points into is next modified.
+class KeyView {
+private:
+    std::string_view keyValue;
+    std::string_view discordUsername;
+    uint64_t id;
+    uint8_t state;
+
+public:
+    KeyView(std::string_view key, uint8_t packedState, std::string_view username, uint64_t keyId = NO_KEY_ID);
+    KeyView(const Key& key);
+
+    std::string_view getKeyValue() const { return keyValue; }
+    std::string_view getDiscordUsername() const { return discordUsername; }
+    uint64_t getId() const { return id; }
+    uint8_t getState() const { return state; }
+    bool getIsUsed() const;
+    KeyType getKeyType() const;
+    std::string_view getKeyTypeName() const;
+
+    // Serialization for storage
+    std::string serialize() const;
+    void serializeTo(std::string& out) const;
+
+    // Parse one record; the view points into serialized
+    static KeyView deserialize(std::string_view serialized, char separator);
+
+    // Digits of an id field, or NO_KEY_ID if it is not one
+    static uint64_t parseId(std::string_view idStr);
+};
+
 // Key class to represent individual license keys
 class Key {
 private:
     std::string keyValue;
-    bool isUsed;
     std::string discordUsername;
-    KeyType keyType;
 
-    // Helper for deserialization
-    static bool deserializeWithSeparator(const std::string& serialized, char separator,
-        std::string& key, KeyType& type,
-        bool& used, std::string& username);
+    // Permanent id given by KeyManager when the key is created, NO_KEY_ID until then
+    uint64_t id = NO_KEY_ID;
+
+    // Type in the low two bits, used flag above them
+    uint8_t state;
+
+    // Helper for deserialization, accepts only "0" to "3"
+    static KeyType parseKeyType(std::string_view typeStr);
+
+    friend class KeyView;
 
 public:
-    Key(const std::string& key, KeyType type = KeyType::Day, bool used = false, const std::string& username = "");
+    static constexpr uint8_t TYPE_MASK = 0x03;
+    static constexpr uint8_t USED_FLAG = 0x04;
+
+    static uint8_t packState(KeyType type, bool used) {
+        return static_cast<uint8_t>((static_cast<int>(type) & TYPE_MASK) | (used ? USED_FLAG : 0));
+    }
+
+    Key(std::string key, KeyType type = KeyType::Day, bool used = false, std::string username = "");
+
+    // Owning copy of a viewed key
+    explicit Key(const KeyView& view);
 
     // Getters
-    std::string getKeyValue() const;
+    std::string_view getKeyValue() const;
     bool getIsUsed() const;
-    std::string getDiscordUsername() const;
+    std::string_view getDiscordUsername() const;
     KeyType getKeyType() const;
-    std::string getKeyTypeName() const;
+    std::string_view getKeyTypeName() const;
+    uint8_t getState() const;
+    uint64_t getId() const;
+
+    static std::string_view typeName(KeyType type);
 
     // Setters
     void setIsUsed(bool used);
-    void setDiscordUsername(const std::string& username);
+    void setDiscordUsername(std::string username);
     void setKeyType(KeyType type);
+    void setId(uint64_t keyId);
 
     // Serialization for storage
     std::string serialize() const;
 
-    // Deserialization from storage
-    static Key deserialize(const std::string& serialized);
+    // Deserialization from storage, detecting the separator from the line itself
+    static Key deserialize(std::string_view serialized);
+
+    // Single pass deserialization with a separator already known for the whole file
+    static Key deserialize(std::string_view serialized, char separator);
+
+    // Pick the separator for a file: '|' for the current format, ',' for legacy files
+    static char detectSeparator(std::string_view serialized);
 };
 
 #endif // KEY_H
\ No newline at end of file
@@ -1,96 +1,367 @@
 #include "KeyCollection.h"
 #include <algorithm>
-#include <sstream>
+#include <functional>
 #include <iostream>
 
-void KeyCollection::addKey(const Key& key) {
-    // Skip keys with empty key values
-    if (key.getKeyValue().empty()) {
+std::string_view KeyCollection::valueOf(const Record& record) const {
+    return std::string_view(valueArena.data() + record.valueOffset, record.valueLength);
+}
+
+size_t KeyCollection::findSlot(std::string_view keyValue, size_t hash) const {
+    size_t mask = valueTable.size() - 1;
+    size_t slot = hash & mask;
+    while (valueTable[slot] != 0 && valueOf(records[valueTable[slot] - 1]) != keyValue) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void KeyCollection::growValueTable(size_t minimumSize) {
+    size_t size = std::max<size_t>(valueTable.size(), 16);
+    while (size < minimumSize) {
+        size *= 2;
+    }
+    if (size == valueTable.size()) {
         return;
     }
 
+    valueTable.assign(size, 0);
+    std::hash<std::string_view> hasher;
+    for (size_t i = 0; i < records.size(); i++) {
+        valueTable[findSlot(valueOf(records[i]), hasher(valueOf(records[i])))] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+bool KeyCollection::addKey(KeyView key) {
+    std::string_view keyValue = key.getKeyValue();
+
+    // Skip keys with empty key values
+    if (keyValue.empty()) {
+        return false;
+    }
+
+    if (keyValue.size() > MAX_KEY_LENGTH || valueArena.size() + keyValue.size() > UINT32_MAX ||
+        records.size() >= UINT32_MAX - 1) {
+        std::cerr << "Warning: Key collection cannot store key of length " << keyValue.size() << std::endl;
+        return false;
+    }
+
+    // Keep the table at most half full
+    if ((records.size() + 1) * 2 > valueTable.size()) {
+        growValueTable((records.size() + 1) * 2);
+    }
+
     // Check if key already exists
-    auto it = std::find_if(keys.begin(), keys.end(),
-        [&key](const Key& existingKey) {
-            return existingKey.getKeyValue() == key.getKeyValue();
-        });
+    size_t slot = findSlot(keyValue, std::hash<std::string_view>()(keyValue));
+    if (valueTable[slot] != 0) {
+        return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(records.size());
+    Record record;
+    record.valueOffset = static_cast<uint32_t>(valueArena.size());
+    record.valueLength = static_cast<uint16_t>(keyValue.size());
+    record.usernameId = usernameIndex.intern(key.getDiscordUsername());
+    record.state = key.getState() & (Key::TYPE_MASK | Key::USED_FLAG);
+
+    valueArena.append(keyValue);
+    records.push_back(record);
+    ids.push_back(key.getId());
+    valueTable[slot] = index + 1;
+
+    countKey(record.state, true);
+    usernameIndex.add(record.usernameId, index);
+    freePosition.push_back(NOT_FREE);
+    if (!(record.state & Key::USED_FLAG)) {
+        addToFreeList(index);
+    }
+    return true;
+}
+
+void KeyCollection::countKey(uint8_t state, bool add) {
+    size_t type = state & Key::TYPE_MASK;
+    bool used = (state & Key::USED_FLAG) != 0;
+    if (add) {
+        stats.total[type]++;
+        if (used) stats.used[type]++;
+    }
+    else {
+        stats.total[type]--;
+        if (used) stats.used[type]--;
+    }
+}
+
+void KeyCollection::setUsername(size_t index, std::string_view username) {
+    Record& record = records[index];
+    uint32_t id = usernameIndex.intern(username);
+    if (id != record.usernameId) {
+        usernameIndex.remove(record.usernameId, static_cast<uint32_t>(index));
+        usernameIndex.add(id, static_cast<uint32_t>(index));
+        record.usernameId = id;
+    }
+}
 
-    if (it == keys.end()) {
-        keys.push_back(key);
+void KeyCollection::addToFreeList(size_t index) {
+    if (freePosition[index] != NOT_FREE) {
+        return;
     }
+
+    auto& slots = freeSlots[records[index].state & Key::TYPE_MASK];
+    freePosition[index] = static_cast<uint32_t>(slots.size());
+    slots.push_back(static_cast<uint32_t>(index));
 }
 
-bool KeyCollection::markKeyAsUsed(size_t index, const std::string& username) {
-    if (index >= keys.size()) {
+void KeyCollection::removeFromFreeList(size_t index) {
+    uint32_t position = freePosition[index];
+    if (position == NOT_FREE) {
+        return;
+    }
+
+    // Swap with the last entry so removal stays O(1)
+    auto& slots = freeSlots[records[index].state & Key::TYPE_MASK];
+    uint32_t last = slots.back();
+    slots[position] = last;
+    freePosition[last] = position;
+    slots.pop_back();
+    freePosition[index] = NOT_FREE;
+}
+
+bool KeyCollection::markKeyAsUsed(size_t index, std::string_view username) {
+    if (index >= records.size()) {
         return false;
     }
 
-    keys[index].setIsUsed(true);
-    keys[index].setDiscordUsername(username);
+    removeFromFreeList(index);
+    Record& record = records[index];
+    if (!(record.state & Key::USED_FLAG)) {
+        stats.used[record.state & Key::TYPE_MASK]++;
+        record.state |= Key::USED_FLAG;
+    }
+    setUsername(index, username);
     return true;
 }
 
 bool KeyCollection::markKeyAsUnused(size_t index) {
-    if (index >= keys.size()) {
+    if (index >= records.size()) {
         return false;
     }
 
-    keys[index].setIsUsed(false);
-    keys[index].setDiscordUsername("");
+    Record& record = records[index];
+    if (record.state & Key::USED_FLAG) {
+        stats.used[record.state & Key::TYPE_MASK]--;
+        record.state &= ~Key::USED_FLAG;
+    }
+    setUsername(index, std::string_view());
+    addToFreeList(index);
     return true;
 }
 
-std::vector<Key> KeyCollection::searchByDiscordUsername(const std::string& username) const {
-    std::vector<Key> results;
-    for (const auto& key : keys) {
-        if (key.getDiscordUsername().find(username) != std::string::npos) {
-            results.push_back(key);
+size_t KeyCollection::findKey(std::string_view keyValue) const {
+    if (valueTable.empty()) {
+        return npos;
+    }
+
+    uint32_t entry = valueTable[findSlot(keyValue, std::hash<std::string_view>()(keyValue))];
+    return entry != 0 ? entry - 1 : npos;
+}
+
+bool KeyCollection::contains(std::string_view keyValue) const {
+    return findKey(keyValue) != npos;
+}
+
+bool KeyCollection::markKeyAsUsedByValue(std::string_view keyValue, std::string_view username) {
+    size_t index = findKey(keyValue);
+    if (index == npos) {
+        return false;
+    }
+
+    return markKeyAsUsed(index, username);
+}
+
+bool KeyCollection::markKeyAsUnusedByValue(std::string_view keyValue) {
+    size_t index = findKey(keyValue);
+    if (index == npos || !(records[index].state & Key::USED_FLAG)) {
+        return false;
+    }
+
+    return markKeyAsUnused(index);
+}
+
+void KeyCollection::applyRecord(KeyView key) {
+    size_t index = findKey(key.getKeyValue());
+    if (index == npos) {
+        addKey(key);
+        return;
+    }
+
+    // The type may change too, so leave the old free list before overwriting
+    removeFromFreeList(index);
+    Record& record = records[index];
+    countKey(record.state, false);
+    record.state = key.getState() & (Key::TYPE_MASK | Key::USED_FLAG);
+    countKey(record.state, true);
+    setUsername(index, key.getDiscordUsername());
+    if (!(record.state & Key::USED_FLAG)) {
+        addToFreeList(index);
+    }
+    if (key.getId() != NO_KEY_ID) {
+        ids[index] = key.getId();
+    }
+}
+
+void KeyCollection::setId(size_t index, uint64_t id) {
+    if (index < ids.size()) {
+        ids[index] = id;
+    }
+}
+
+size_t KeyCollection::claimKey(KeyType type, std::string_view username) {
+    auto& slots = freeSlots[static_cast<size_t>(type) % KEY_TYPE_COUNT];
+    if (slots.empty()) {
+        return npos;
+    }
+
+    size_t index = slots.back();
+    markKeyAsUsed(index, username);
+    return index;
+}
+
+size_t KeyCollection::availableCount(KeyType type) const {
+    return freeSlots[static_cast<size_t>(type) % KEY_TYPE_COUNT].size();
+}
+
+const KeyStats& KeyCollection::getStats() const {
+    return stats;
+}
+
+KeyStats KeyCollection::recountStats() const {
+    KeyStats recounted;
+    for (const auto& record : records) {
+        size_t type = record.state & Key::TYPE_MASK;
+        recounted.total[type]++;
+        if (record.state & Key::USED_FLAG) recounted.used[type]++;
+    }
+    return recounted;
+}
+
+std::vector<size_t> KeyCollection::findByUsername(const std::string& username) const {
+    return usernameIndex.findExact(username);
+}
+
+std::vector<size_t> KeyCollection::searchByUsername(const std::string& fragment) const {
+    if (fragment.empty()) {
+        std::vector<size_t> all(records.size());
+        for (size_t i = 0; i < all.size(); i++) {
+            all[i] = i;
+        }
+        return all;
+    }
+
+    return usernameIndex.findContaining(fragment);
+}
+
+void KeyCollection::forEach(const KeyFilter& filter, const KeyVisitor& visit) const {
+    for (size_t i = 0; i < records.size(); i++) {
+        KeyView key = at(i);
+        if (filter.matches(key)) {
+            visit(i, key);
         }
     }
+}
+
+void KeyCollection::forEachByUsername(const std::string& username, bool substring, const KeyVisitor& visit) const {
+    if (substring && username.empty()) {
+        forEach(KeyFilter(), visit);
+        return;
+    }
+
+    for (size_t index : substring ? usernameIndex.findContaining(username) : usernameIndex.findExact(username)) {
+        visit(index, at(index));
+    }
+}
+
+std::vector<Key> KeyCollection::searchByDiscordUsername(const std::string& username) const {
+    std::vector<Key> results;
+    forEachByUsername(username, true, [&results](size_t, const KeyView& key) { results.emplace_back(key); });
     return results;
 }
 
 std::vector<Key> KeyCollection::getAllKeys() const {
+    std::vector<Key> keys;
+    keys.reserve(records.size());
+    forEach(KeyFilter(), [&keys](size_t, const KeyView& key) { keys.emplace_back(key); });
     return keys;
 }
 
 std::string KeyCollection::serialize() const {
-    std::stringstream ss;
-    for (const auto& key : keys) {
-        ss << key.serialize() << std::endl;
+    std::string serialized;
+    serialized.reserve(valueArena.size() + records.size() * 8);
+    for (size_t i = 0; i < records.size(); i++) {
+        at(i).serializeTo(serialized);
+        serialized += '\n';
     }
-    return ss.str();
+    return serialized;
 }
 
 KeyCollection KeyCollection::deserialize(const std::string& serialized) {
+    return deserialize(std::string_view(serialized));
+}
+
+KeyCollection KeyCollection::deserialize(std::string_view serialized) {
     KeyCollection collection;
 
+    // One key per line, so the newline count is a good capacity estimate
+    if (!serialized.empty()) {
+        collection.reserve(std::count(serialized.begin(), serialized.end(), '\n') + 1);
+    }
+
+    parseRecords(serialized, [&collection](const KeyView& key) {
+        collection.addKey(key);
+    });
+    return collection;
+}
+
+size_t KeyCollection::parseRecords(std::string_view serialized, const RecordVisitor& visit) {
+    int validKeys = 0;
+
     try {
         // Special case for empty input
         if (serialized.empty()) {
-            return collection;
+            return 0;
         }
 
-        std::stringstream ss(serialized);
-        std::string line;
+        // Pipe or legacy comma format, decided once for the whole file
+        char separator = Key::detectSeparator(serialized);
         int lineNumber = 0;
-        int validKeys = 0;
         int invalidKeys = 0;
+        size_t lineStart = 0;
 
-        while (std::getline(ss, line)) {
+        while (lineStart < serialized.size()) {
+            size_t lineEnd = serialized.find('\n', lineStart);
+            if (lineEnd == std::string_view::npos) {
+                lineEnd = serialized.size();
+            }
+
+            std::string_view lineView = serialized.substr(lineStart, lineEnd - lineStart);
+            lineStart = lineEnd + 1;
             lineNumber++;
 
+            // Raw file bytes keep the CR of Windows line endings
+            if (!lineView.empty() && lineView.back() == '\r') {
+                lineView.remove_suffix(1);
+            }
+
             // Skip empty lines
-            if (line.empty()) {
+            if (lineView.empty()) {
                 continue;
             }
 
             try {
-                Key key = Key::deserialize(line);
+                KeyView key = KeyView::deserialize(lineView, separator);
 
-                // Only add keys that have a non-empty key value
+                // Only pass on keys that have a non-empty key value
                 if (!key.getKeyValue().empty()) {
-                    collection.addKey(key);
+                    visit(key);
                     validKeys++;
                 }
                 else {
@@ -121,21 +392,37 @@ KeyCollection KeyCollection::deserialize(const std::string& serialized) {
         std::cerr << "Unknown error deserializing key collection" << std::endl;
     }
 
-    return collection;
+    return static_cast<size_t>(validKeys);
 }
 
-size_t KeyCollection::size() const {
-    return keys.size();
+void KeyCollection::reserve(size_t count, size_t valueBytes) {
+    records.reserve(count);
+    ids.reserve(count);
+    valueArena.reserve(valueBytes);
+    freePosition.reserve(count);
+    growValueTable(count * 2);
 }
 
-const Key& KeyCollection::at(size_t index) const {
-    static Key emptyKey(""); // Static fallback for out-of-bounds access
+size_t KeyCollection::size() const {
+    return records.size();
+}
 
-    if (index < keys.size()) {
-        return keys.at(index);
+KeyView KeyCollection::at(size_t index) const {
+    if (index < records.size()) {
+        const Record& record = records[index];
+        return KeyView(valueOf(record), record.state, usernameIndex.nameOf(record.usernameId), ids[index]);
     }
     else {
         std::cerr << "Warning: Attempted to access key at invalid index " << index << std::endl;
-        return emptyKey;
+        return KeyView(std::string_view(), 0, std::string_view());
+    }
+}
+
+size_t KeyCollection::memoryUsage() const {
+    size_t bytes = records.capacity() * sizeof(Record) + ids.capacity() * sizeof(uint64_t) + valueArena.capacity() +
+        valueTable.capacity() * sizeof(uint32_t) + freePosition.capacity() * sizeof(uint32_t);
+    for (const auto& slots : freeSlots) {
+        bytes += slots.capacity() * sizeof(uint32_t);
     }
+    return bytes + usernameIndex.memoryUsage();
 }
\ No newline at end of file
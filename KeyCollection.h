@@ -2,20 +2,148 @@
 #define KEYCOLLECTION_H
 
 #include "Key.h"
+#include "UsernameIndex.h"
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <vector>
 #include <string>
+#include <string_view>
 
-// Key collection class to manage multiple keys
+// Key counts per type, maintained incrementally by KeyCollection
+struct KeyStats {
+    static constexpr size_t TYPE_COUNT = 4;
+    size_t total[TYPE_COUNT] = {};
+    size_t used[TYPE_COUNT] = {};
+
+    size_t totalOf(KeyType type) const { return total[static_cast<size_t>(type) % TYPE_COUNT]; }
+    size_t usedOf(KeyType type) const { return used[static_cast<size_t>(type) % TYPE_COUNT]; }
+    size_t availableOf(KeyType type) const { return totalOf(type) - usedOf(type); }
+
+    size_t totalKeys() const { return total[0] + total[1] + total[2] + total[3]; }
+    size_t usedKeys() const { return used[0] + used[1] + used[2] + used[3]; }
+    size_t availableKeys() const { return totalKeys() - usedKeys(); }
+
+    bool operator==(const KeyStats& other) const = default;
+
+    KeyStats& operator+=(const KeyStats& other) {
+        for (size_t i = 0; i < TYPE_COUNT; i++) {
+            total[i] += other.total[i];
+            used[i] += other.used[i];
+        }
+        return *this;
+    }
+};
+
+// Which keys a visit reaches; an unset field matches every key
+struct KeyFilter {
+    std::optional<KeyType> type;
+    std::optional<bool> used;
+
+    bool matches(const KeyView& key) const {
+        return (!type || key.getKeyType() == *type) && (!used || key.getIsUsed() == *used);
+    }
+};
+
+// Called with a key's index (or id, for KeyManager) and a view into the collection. The view is
+// only valid during the call, and the visitor must not modify the collection it is visiting.
+using KeyVisitor = std::function<void(size_t, const KeyView&)>;
+
+// Called with each record read from storage, in storage order. The view is only valid during the call.
+using RecordVisitor = std::function<void(const KeyView&)>;
+
+// Key collection class to manage multiple keys.
+// Keys are stored compactly: a 12 byte record per key holding its value's
+// offset in a shared character arena, its interned username id and its packed
+// type/used byte, plus the key's permanent id in a parallel array. Lookups by
+// value go through an open addressing table of record numbers, so no key
+// string is stored twice. at() returns a KeyView
+// into that storage, valid until the collection is next modified.
 class KeyCollection {
 private:
-    std::vector<Key> keys;
+    struct Record {
+        uint32_t valueOffset;
+        uint32_t usernameId;
+        uint16_t valueLength;
+        uint8_t state;
+    };
+
+    std::vector<Record> records;
+    std::vector<uint64_t> ids;
+    std::string valueArena;
+
+    // Hash index from key value to record number + 1 (0 marks an empty slot),
+    // linear probing, power of two size kept at most half full
+    std::vector<uint32_t> valueTable;
+    size_t findSlot(std::string_view keyValue, size_t hash) const;
+    void growValueTable(size_t minimumSize);
+    std::string_view valueOf(const Record& record) const;
+
+    // Per-type free lists of unused slots, and each slot's position in its list (NOT_FREE when used)
+    static constexpr size_t KEY_TYPE_COUNT = 4;
+    static constexpr uint32_t NOT_FREE = UINT32_MAX;
+    std::vector<uint32_t> freeSlots[KEY_TYPE_COUNT];
+    std::vector<uint32_t> freePosition;
+
+    void addToFreeList(size_t index);
+    void removeFromFreeList(size_t index);
+
+    // Running totals, adjusted on every add, mark, unmark and record replay
+    KeyStats stats;
+    void countKey(uint8_t state, bool add);
+
+    // Username intern table and index, updated wherever a key's username changes
+    UsernameIndex usernameIndex;
+    void setUsername(size_t index, std::string_view username);
 
 public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Longest key value a record can hold
+    static constexpr size_t MAX_KEY_LENGTH = UINT16_MAX;
+
     KeyCollection() = default;
 
-    void addKey(const Key& key);
-    bool markKeyAsUsed(size_t index, const std::string& username);
+    // Returns true if the key was added, false if it was empty, too long or a duplicate
+    bool addKey(KeyView key);
+    bool markKeyAsUsed(size_t index, std::string_view username);
     bool markKeyAsUnused(size_t index);
+
+    // Constant time lookups by key value
+    size_t findKey(std::string_view keyValue) const;
+    bool contains(std::string_view keyValue) const;
+    bool markKeyAsUsedByValue(std::string_view keyValue, std::string_view username);
+    bool markKeyAsUnusedByValue(std::string_view keyValue);
+
+    // Insert the key, or overwrite the state (and id, if the record has one) of the existing key with the same value
+    void applyRecord(KeyView key);
+
+    // Give a key the id it is known by outside the collection
+    void setId(size_t index, uint64_t id);
+
+    // Hand out an unused key of the given type in O(1). Returns its index, or npos if none is left.
+    size_t claimKey(KeyType type, std::string_view username);
+    size_t availableCount(KeyType type) const;
+
+    // O(1) counts per type
+    const KeyStats& getStats() const;
+
+    // Full scan for the consistency self-check; should always equal getStats()
+    KeyStats recountStats() const;
+
+    // Indexes of the keys held by exactly this username, ascending
+    std::vector<size_t> findByUsername(const std::string& username) const;
+
+    // Indexes of the keys whose username contains fragment, ascending (every key for an empty fragment)
+    std::vector<size_t> searchByUsername(const std::string& fragment) const;
+
+    // Visit the matching keys in index order without copying any of them
+    void forEach(const KeyFilter& filter, const KeyVisitor& visit) const;
+
+    // Visit the keys whose username is (or with substring, contains) username, in index order
+    void forEachByUsername(const std::string& username, bool substring, const KeyVisitor& visit) const;
+
+    // Copies, for callers that keep the keys past the next modification
     std::vector<Key> searchByDiscordUsername(const std::string& username) const;
     std::vector<Key> getAllKeys() const;
 
@@ -25,8 +153,20 @@ public:
     // Deserialization from storage
     static KeyCollection deserialize(const std::string& serialized);
 
+    // Parses lines in place, e.g. straight out of a memory mapped file
+    static KeyCollection deserialize(std::string_view serialized);
+
+    // Parse lines in place like deserialize, but hand each record with a key value to visit
+    // instead of building a collection. Returns the number of records visited.
+    static size_t parseRecords(std::string_view serialized, const RecordVisitor& visit);
+
+    // Room for count keys whose values take valueBytes in total
+    void reserve(size_t count, size_t valueBytes = 0);
     size_t size() const;
-    const Key& at(size_t index) const;
+    KeyView at(size_t index) const;
+
+    // Bytes held by the collection and its indexes
+    size_t memoryUsage() const;
 };
 
 #endif // KEYCOLLECTION_H
\ No newline at end of file
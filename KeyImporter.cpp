@@ -1,26 +1,188 @@
 #include "KeyImporter.h"
-#include <fstream>
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <stdexcept>
+#include <thread>
+#include <unordered_set>
 
-std::vector<std::string> KeyImporter::importFromFile(const std::string& filename) {
-    std::vector<std::string> importedKeys;
-    std::ifstream file(filename);
+namespace {
+    // Files smaller than this per thread are not worth splitting further
+    constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    struct Candidate {
+        std::string_view value;
+        size_t hash;
+        bool duplicate;
+    };
+
+    struct Chunk {
+        std::string_view text;
+        std::vector<Candidate> candidates;
+        std::vector<std::string> keys;
+        size_t lines = 0;
+        size_t rejected = 0;
+        size_t duplicates = 0;
+    };
+
+    // The sets reuse the hash computed while scanning, so every line is hashed once
+    struct CandidateHash {
+        size_t operator()(const Candidate* candidate) const { return candidate->hash; }
+    };
+
+    struct CandidateEqual {
+        bool operator()(const Candidate* a, const Candidate* b) const { return a->value == b->value; }
+    };
+
+    // Spread hashes over partitions using their high bits, leaving the low bits to the sets' buckets
+    size_t partitionOf(size_t hash, size_t partitions) {
+        return static_cast<size_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> 40) % partitions;
+    }
+
+    // Run work(0) .. work(count - 1), one per thread, on the calling thread too
+    template <typename Work>
+    void runParallel(size_t count, Work work) {
+        std::vector<std::thread> threads;
+        threads.reserve(count - 1);
+        for (size_t i = 1; i < count; i++) {
+            threads.emplace_back(work, i);
+        }
+        work(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void scanChunk(Chunk& chunk) {
+        std::string_view text = chunk.text;
+        std::hash<std::string_view> hasher;
+        size_t pos = 0;
+
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = text.size();
+            }
+            std::string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+            chunk.lines++;
+
+            // Trim whitespace
+            size_t first = line.find_first_not_of(" \t\r\n");
+            if (first == std::string_view::npos) {
+                continue;
+            }
+            line = line.substr(first, line.find_last_not_of(" \t\r\n") - first + 1);
 
-    if (!file.is_open()) {
+            if (!KeyImporter::isValidKey(line)) {
+                chunk.rejected++;
+                continue;
+            }
+
+            chunk.candidates.push_back({ line, hasher(line), false });
+        }
+    }
+}
+
+bool KeyImporter::isValidKey(std::string_view keyValue) {
+    if (keyValue.empty() || keyValue.size() > MAX_KEY_LENGTH) {
+        return false;
+    }
+
+    return std::none_of(keyValue.begin(), keyValue.end(), [](char c) {
+        return static_cast<unsigned char>(c) < 0x20 || c == 0x7F || c == '|' || c == ',';
+        });
+}
+
+bool KeyImporter::isValidUsername(std::string_view username) {
+    if (username.empty() || username.size() > MAX_USERNAME_LENGTH) {
+        return false;
+    }
+
+    return std::none_of(username.begin(), username.end(), [](char c) {
+        return static_cast<unsigned char>(c) < 0x20 || c == 0x7F || c == '|' || c == ',';
+        });
+}
+
+std::vector<std::string> KeyImporter::importFromFile(const std::string& filename, ImportReport& report,
+    unsigned threadCount) {
+    auto started = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.open(filename)) {
         throw std::runtime_error("Unable to open file: " + filename);
     }
+    std::string_view text = file.view();
 
-    std::string line;
-    while (std::getline(file, line)) {
-        // Trim whitespace
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+    size_t threads = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max<size_t>(1, std::min(threads, text.size() / MIN_CHUNK_SIZE));
 
-        if (!line.empty()) {
-            importedKeys.push_back(line);
+    // Split at line boundaries into roughly equal chunks
+    std::vector<Chunk> chunks(threads);
+    size_t start = 0;
+    for (size_t i = 0; i < threads; i++) {
+        size_t end = text.size();
+        if (i + 1 < threads) {
+            end = text.find('\n', std::max(start, text.size() / threads * (i + 1)));
+            end = end == std::string_view::npos ? text.size() : end + 1;
         }
+        chunks[i].text = text.substr(start, end - start);
+        start = end;
     }
 
-    file.close();
+    // Trim, validate and hash each chunk
+    runParallel(threads, [&chunks](size_t i) { scanChunk(chunks[i]); });
+
+    // Deduplicate by hash partition, walking the chunks in order so the first occurrence wins
+    size_t candidateCount = 0;
+    for (const auto& chunk : chunks) {
+        candidateCount += chunk.candidates.size();
+    }
+
+    runParallel(threads, [&chunks, threads, candidateCount](size_t partition) {
+        std::unordered_set<const Candidate*, CandidateHash, CandidateEqual> seen;
+        seen.reserve(candidateCount / threads + 1);
+
+        for (auto& chunk : chunks) {
+            for (auto& candidate : chunk.candidates) {
+                if (partitionOf(candidate.hash, threads) == partition && !seen.insert(&candidate).second) {
+                    candidate.duplicate = true;
+                }
+            }
+        }
+        });
+
+    // Copy the surviving keys out of the mapping
+    runParallel(threads, [&chunks](size_t i) {
+        Chunk& chunk = chunks[i];
+        chunk.keys.reserve(chunk.candidates.size());
+        for (const auto& candidate : chunk.candidates) {
+            if (candidate.duplicate) {
+                chunk.duplicates++;
+            }
+            else {
+                chunk.keys.emplace_back(candidate.value);
+            }
+        }
+        });
+
+    std::vector<std::string> importedKeys;
+    importedKeys.reserve(candidateCount);
+    for (auto& chunk : chunks) {
+        report.lines += chunk.lines;
+        report.rejected += chunk.rejected;
+        report.duplicates += chunk.duplicates;
+        std::move(chunk.keys.begin(), chunk.keys.end(), std::back_inserter(importedKeys));
+    }
+
+    report.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
     return importedKeys;
+}
+
+std::vector<std::string> KeyImporter::importFromFile(const std::string& filename) {
+    ImportReport report;
+    return importFromFile(filename, report);
 }
\ No newline at end of file
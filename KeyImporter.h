@@ -3,11 +3,45 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+
+// Counters of a bulk import
+struct ImportReport {
+    size_t lines = 0;       // Lines read, blank ones included
+    size_t imported = 0;    // Keys added to the collection
+    size_t duplicates = 0;  // Repeated within the file or already present
+    size_t rejected = 0;    // Failed validation
+    double seconds = 0.0;
+
+    double linesPerSecond() const {
+        return seconds > 0.0 ? lines / seconds : 0.0;
+    }
+};
 
 // KeyImporter class to handle importing keys from external files
 class KeyImporter {
 public:
+    // Longest key value accepted on import
+    static constexpr size_t MAX_KEY_LENGTH = 256;
+
+    // Longest Discord username accepted for a key holder
+    static constexpr size_t MAX_USERNAME_LENGTH = 256;
+
+    // Trimmed, valid key values of a file in file order, without repeats.
+    // The file is memory mapped and split into chunks that are trimmed, validated
+    // and deduplicated on threadCount threads (0 picks one per core).
+    // Fills lines, duplicates (within the file) and rejected in report.
+    static std::vector<std::string> importFromFile(const std::string& filename, ImportReport& report,
+        unsigned threadCount = 0);
+
     static std::vector<std::string> importFromFile(const std::string& filename);
+
+    // A key value must be non-empty, short enough and free of control characters
+    // and of the '|' and ',' database separators
+    static bool isValidKey(std::string_view keyValue);
+
+    // A username must pass the same checks, so it cannot split or merge database records
+    static bool isValidUsername(std::string_view username);
 };
 
 #endif // KEYIMPORTER_H
\ No newline at end of file
@@ -1,24 +1,28 @@
 #include "KeyManager.h"
-#include "FileSystemStorage.h"
-#include "FileManager.h"
+#include "StorageFactory.h"
 #include "KeyImporter.h"
 #include <iostream>
-#include <map>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 KeyManager::KeyManager() {
+    createShards(DEFAULT_SHARD_COUNT);
     try {
-        std::string storagePath = FileManager::getAppDataPath() + "keys.csv";
-        storage = std::make_unique<FileSystemStorage>(storagePath);
+        storage = StorageFactory::createStorage();
+        loadKeys();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error initializing storage: " << e.what() << std::endl;
+        std::cout << "Starting with empty key collection." << std::endl;
+    }
+}
 
-        if (storage->exists()) {
-            std::string serialized = storage->loadKeys();
-            m_keyCollection = KeyCollection::deserialize(serialized);
-            std::cout << "Loaded existing key storage with " << m_keyCollection.size() << " keys." << std::endl;
-        }
-        else {
-            std::cout << "No existing key storage found. A new one will be created." << std::endl;
-        }
+KeyManager::KeyManager(std::unique_ptr<IKeyStorage> keyStorage, size_t shardCount) : storage(std::move(keyStorage)) {
+    createShards(shardCount);
+    try {
+        loadKeys();
     }
     catch (const std::exception& e) {
         std::cerr << "Error initializing storage: " << e.what() << std::endl;
@@ -26,107 +30,563 @@ KeyManager::KeyManager() {
     }
 }
 
-void KeyManager::importKeysFromFile(const std::string& filename, KeyType keyType) {
+void KeyManager::createShards(size_t shardCount) {
+    shards.clear();
+    for (size_t i = 0; i < std::max<size_t>(shardCount, 1); i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+size_t KeyManager::shardIndexOf(std::string_view keyValue) const {
+    // KeyCollection's table uses the low bits of the same hash, so pick the shard from the high bits
+    uint64_t hash = std::hash<std::string_view>()(keyValue);
+    return static_cast<size_t>(((hash * 0x9e3779b97f4a7c15ULL) >> 32) % shards.size());
+}
+
+void KeyManager::loadKeys() {
+    if (storage->exists()) {
+        // Stream the records straight into their shards, so every index is built once. Journal
+        // records overwrite the key with the same value, and loadOrder remembers where each key
+        // was first seen.
+        std::vector<Location> loadOrder;
+        storage->loadRecords([&](const KeyView& record) {
+            if (record.getKeyValue().empty()) {
+                return;
+            }
+            size_t shardIndex = shardIndexOf(record.getKeyValue());
+            KeyCollection& keys = shards[shardIndex]->keys;
+            size_t before = keys.size();
+            keys.applyRecord(record);
+            if (keys.size() > before) {
+                loadOrder.push_back({ static_cast<uint32_t>(shardIndex), static_cast<uint32_t>(before) });
+            }
+        });
+
+        // Keep every stored id that is unique, however sparse. Keys without one, e.g. every key
+        // of a database older than ids, and later duplicates of an id get new ids past the
+        // highest stored one in file order, so an old database keeps the positions it was
+        // addressed by.
+        order.reserve(loadOrder.size());
+        for (const Location& location : loadOrder) {
+            uint64_t id = shards[location.shard]->keys.at(location.local).getId();
+            if (id != NO_KEY_ID) {
+                order.push_back({ id, location });
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [](const IdEntry& a, const IdEntry& b) { return a.id < b.id; });
+
+        size_t duplicates = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (kept > 0 && order[kept - 1].id == order[i].id) {
+                shards[order[i].location.shard]->keys.setId(order[i].location.local, NO_KEY_ID);
+                duplicates++;
+                continue;
+            }
+            order[kept++] = order[i];
+        }
+        order.resize(kept);
+        nextId = order.empty() ? 0 : order.back().id + 1;
+
+        size_t assigned = 0;
+        for (const Location& location : loadOrder) {
+            KeyCollection& keys = shards[location.shard]->keys;
+            if (keys.at(location.local).getId() != NO_KEY_ID) {
+                continue;
+            }
+            if (nextId == NO_KEY_ID) {
+                std::cerr << "Warning: No id left for key " << keys.at(location.local).getKeyValue()
+                    << ", it can only be reached by value." << std::endl;
+                continue;
+            }
+            keys.setId(location.local, nextId);
+            order.push_back({ nextId++, location });
+            assigned++;
+        }
+
+        std::cout << "Loaded existing key storage with " << loadOrder.size() << " keys." << std::endl;
+
+        // Write the new ids out once, so they no longer depend on the order of the file
+        if (assigned > 0) {
+            std::cout << "Assigned new ids to " << assigned << " keys (" << duplicates
+                << " with a duplicate id, the rest with none)." << std::endl;
+            saveKeys();
+        }
+    }
+    else {
+        std::cout << "No existing key storage found. A new one will be created." << std::endl;
+    }
+}
+
+std::shared_lock<std::shared_mutex> KeyManager::readLock(std::shared_mutex& mutex) const {
+    std::shared_lock<std::shared_mutex> lock(mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        metrics.readLockWait.observe(std::chrono::nanoseconds(0));
+        return lock;
+    }
+
+    // Only contended acquisitions pay for reading the clock
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    metrics.readLockWait.observe(std::chrono::steady_clock::now() - start);
+    return lock;
+}
+
+std::unique_lock<std::shared_mutex> KeyManager::writeLock(std::shared_mutex& mutex) const {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        metrics.writeLockWait.observe(std::chrono::nanoseconds(0));
+        return lock;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    metrics.writeLockWait.observe(std::chrono::steady_clock::now() - start);
+    return lock;
+}
+
+std::vector<std::shared_lock<std::shared_mutex>> KeyManager::readLockAll() const {
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(shards.size());
+    for (const auto& shard : shards) {
+        locks.push_back(readLock(shard->mutex));
+    }
+    return locks;
+}
+
+bool KeyManager::addLocked(size_t shardIndex, KeyView key) {
+    Shard& shard = *shards[shardIndex];
+    uint64_t id = nextId;
+    if (id == NO_KEY_ID || shard.keys.size() >= UINT32_MAX ||
+        !shard.keys.addKey(KeyView(key.getKeyValue(), key.getState(), key.getDiscordUsername(), id))) {
+        return false;
+    }
+
+    shard.drainedTypes &= ~typeBit(key.getKeyType());
+    changes.publish(ChangeFeed::Kind::Added, shard.keys.at(shard.keys.size() - 1));
+    // New ids are the highest yet, so appending keeps order sorted
+    order.push_back({ id, { static_cast<uint32_t>(shardIndex), static_cast<uint32_t>(shard.keys.size() - 1) } });
+    nextId++;
+    return true;
+}
+
+size_t KeyManager::orderPosition(uint64_t id) const {
+    // Ids are unique and ascending, so an entry is never below its position; with dense
+    // ids it sits exactly there
+    if (id < order.size() && order[id].id == id) {
+        return static_cast<size_t>(id);
+    }
+    return std::lower_bound(order.begin(), order.end(), id,
+        [](const IdEntry& entry, uint64_t value) { return entry.id < value; }) - order.begin();
+}
+
+std::optional<KeyManager::Location> KeyManager::locate(uint64_t id) const {
+    auto orderLock = readLock(orderMutex);
+    size_t position = orderPosition(id);
+    if (position == order.size() || order[position].id != id) {
+        return std::nullopt;
+    }
+    return order[position].location;
+}
+
+bool KeyManager::markUsedLocked(Shard& shard, size_t local, const std::string& discordUsername, uint64_t& ticket) {
+    if (!shard.keys.markKeyAsUsed(local, discordUsername)) {
+        return false;
+    }
+    changes.publish(ChangeFeed::Kind::Used, shard.keys.at(local));
+    ticket = persistKey(shard.keys.at(local));
+    return true;
+}
+
+bool KeyManager::markUnusedLocked(Shard& shard, size_t local, uint64_t& ticket) {
+    if (!shard.keys.at(local).getIsUsed() || !shard.keys.markKeyAsUnused(local)) {
+        return false;
+    }
+    shard.drainedTypes &= ~typeBit(shard.keys.at(local).getKeyType());
+    changes.publish(ChangeFeed::Kind::Unused, shard.keys.at(local));
+    ticket = persistKey(shard.keys.at(local));
+    return true;
+}
+
+uint32_t KeyManager::typeBit(KeyType keyType) {
+    return 1u << static_cast<uint32_t>(keyType);
+}
+
+uint64_t KeyManager::getVersion() const {
+    return changes.latestVersion();
+}
+
+size_t KeyManager::keyCount() const {
+    auto orderLock = readLock(orderMutex);
+    return order.size();
+}
+
+void KeyManager::forEachKey(const KeyFilter& filter, const KeyVisitor& visit) const {
+    forEachKeyPage(0, SIZE_MAX, filter, visit);
+}
+
+size_t KeyManager::forEachKeyPage(size_t cursor, size_t limit, const KeyFilter& filter, const KeyVisitor& visit) const {
+    auto orderLock = readLock(orderMutex);
+    auto shardLocks = readLockAll();
+    size_t position = orderPosition(cursor);
+    size_t visited = 0;
+    for (; position < order.size() && visited < limit; position++) {
+        const IdEntry& entry = order[position];
+        KeyView key = shards[entry.location.shard]->keys.at(entry.location.local);
+        if (filter.matches(key)) {
+            visit(static_cast<size_t>(entry.id), key);
+            visited++;
+        }
+    }
+
+    return position < order.size() ? static_cast<size_t>(order[position].id) : KeyCollection::npos;
+}
+
+void KeyManager::forEachKeyOfUser(const std::string& username, bool substring, const KeyVisitor& visit) const {
+    // Every shard has its own username index; gather the matches from all of them, then
+    // visit in id order while the shards are still locked
+    struct Match {
+        uint64_t id;
+        uint32_t shard;
+        uint32_t local;
+    };
+    std::vector<Match> matches;
+
+    auto shardLocks = readLockAll();
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i]->keys.forEachByUsername(username, substring, [&matches, i](size_t local, const KeyView& key) {
+            matches.push_back({ key.getId(), static_cast<uint32_t>(i), static_cast<uint32_t>(local) });
+        });
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) { return a.id < b.id; });
+    for (const auto& match : matches) {
+        visit(static_cast<size_t>(match.id), shards[match.shard]->keys.at(match.local));
+    }
+}
+
+std::optional<Key> KeyManager::getKeyById(uint64_t id) const {
+    auto location = locate(id);
+    if (!location) {
+        return std::nullopt;
+    }
+
+    const Shard& shard = *shards[location->shard];
+    auto lock = readLock(shard.mutex);
+    return Key(shard.keys.at(location->local));
+}
+
+std::optional<std::pair<size_t, Key>> KeyManager::findKey(const std::string& keyValue) const {
+    const Shard& shard = *shards[shardIndexOf(keyValue)];
+    auto lock = readLock(shard.mutex);
+    size_t local = shard.keys.findKey(keyValue);
+    if (local == KeyCollection::npos) {
+        return std::nullopt;
+    }
+
+    KeyView key = shard.keys.at(local);
+    return std::make_pair(static_cast<size_t>(key.getId()), Key(key));
+}
+
+bool KeyManager::addKey(const Key& key) {
+    size_t shardIndex = shardIndexOf(key.getKeyValue());
+    Shard& shard = *shards[shardIndex];
+    uint64_t ticket;
+    {
+        auto orderLock = writeLock(orderMutex);
+        auto lock = writeLock(shard.mutex);
+        if (!addLocked(shardIndex, key)) {
+            return false;
+        }
+        ticket = persistKey(shard.keys.at(shard.keys.size() - 1));
+    }
+    commit(ticket);
+    return true;
+}
+
+bool KeyManager::markKeyByValue(const std::string& keyValue, const std::string& discordUsername) {
+    Shard& shard = *shards[shardIndexOf(keyValue)];
+    uint64_t ticket;
+    {
+        auto lock = writeLock(shard.mutex);
+        size_t local = shard.keys.findKey(keyValue);
+        if (local == KeyCollection::npos || !markUsedLocked(shard, local, discordUsername, ticket)) {
+            return false;
+        }
+    }
+    commit(ticket);
+    return true;
+}
+
+bool KeyManager::markKeyAsUnusedByValue(const std::string& keyValue) {
+    Shard& shard = *shards[shardIndexOf(keyValue)];
+    uint64_t ticket;
+    {
+        auto lock = writeLock(shard.mutex);
+        size_t local = shard.keys.findKey(keyValue);
+        if (local == KeyCollection::npos || !markUnusedLocked(shard, local, ticket)) {
+            return false;
+        }
+    }
+    commit(ticket);
+    return true;
+}
+
+bool KeyManager::markKeyById(uint64_t id, const std::string& discordUsername) {
+    auto location = locate(id);
+    if (!location) {
+        return false;
+    }
+
+    Shard& shard = *shards[location->shard];
+    uint64_t ticket;
+    {
+        auto lock = writeLock(shard.mutex);
+        if (!markUsedLocked(shard, location->local, discordUsername, ticket)) {
+            return false;
+        }
+    }
+    commit(ticket);
+    return true;
+}
+
+bool KeyManager::markKeyAsUnusedById(uint64_t id) {
+    auto location = locate(id);
+    if (!location) {
+        return false;
+    }
+
+    Shard& shard = *shards[location->shard];
+    uint64_t ticket;
+    {
+        auto lock = writeLock(shard.mutex);
+        if (!markUnusedLocked(shard, location->local, ticket)) {
+            return false;
+        }
+    }
+    commit(ticket);
+    return true;
+}
+
+std::optional<Key> KeyManager::claimKey(KeyType keyType, const std::string& discordUsername) {
+    // Threads get consecutive home shards, so concurrent claims start on different locks
+    static std::atomic<size_t> nextHomeShard(0);
+    thread_local size_t homeShard = nextHomeShard++;
+
+    // Skip shards known to be out of the type; if every shard looks drained, check them all
+    // under their locks once so a key released since the bit was read is still found
+    uint32_t bit = typeBit(keyType);
+    for (size_t i = 0; i < 2 * shards.size(); i++) {
+        Shard& shard = *shards[(homeShard + i) % shards.size()];
+        bool trustDrained = i < shards.size();
+        if (trustDrained && (shard.drainedTypes.load(std::memory_order_relaxed) & bit)) {
+            continue;
+        }
+
+        std::optional<Key> claimed;
+        uint64_t ticket;
+        {
+            auto lock = writeLock(shard.mutex);
+            size_t local = shard.keys.claimKey(keyType, discordUsername);
+            if (local == KeyCollection::npos) {
+                shard.drainedTypes |= bit;
+                continue;
+            }
+            KeyView key = shard.keys.at(local);
+            changes.publish(ChangeFeed::Kind::Used, key);
+            claimed.emplace(key);
+            ticket = persistKey(key);
+        }
+        commit(ticket);
+        return claimed;
+    }
+
+    return std::nullopt;
+}
+
+std::vector<BatchOutcome> KeyManager::applyBatch(const std::vector<BatchOperation>& operations) {
+    std::vector<BatchOutcome> outcomes;
+    outcomes.reserve(operations.size());
+
+    uint64_t lastTicket = 0;
+    bool fullSave = false;
+    {
+        // orderMutex is only needed when the batch adds keys
+        bool adds = std::any_of(operations.begin(), operations.end(),
+            [](const BatchOperation& op) { return op.kind == BatchOperation::Kind::Add; });
+        std::unique_lock<std::shared_mutex> orderLock;
+        if (adds) {
+            orderLock = writeLock(orderMutex);
+        }
+        std::vector<std::unique_lock<std::shared_mutex>> shardLocks;
+        for (auto& shard : shards) {
+            shardLocks.push_back(writeLock(shard->mutex));
+        }
+
+        for (const auto& op : operations) {
+            size_t shardIndex = shardIndexOf(op.value);
+            Shard& shard = *shards[shardIndex];
+            size_t local = KeyCollection::npos;
+            BatchOutcome outcome = BatchOutcome::Applied;
+
+            if (op.kind == BatchOperation::Kind::Add) {
+                if (addLocked(shardIndex, KeyView(op.value, Key::packState(op.type, false), std::string_view()))) {
+                    local = shard.keys.size() - 1;
+                }
+                else {
+                    outcome = BatchOutcome::AlreadyExists;
+                }
+            }
+            else if ((local = shard.keys.findKey(op.value)) == KeyCollection::npos) {
+                outcome = BatchOutcome::NotFound;
+            }
+            else if (op.kind == BatchOperation::Kind::Use) {
+                shard.keys.markKeyAsUsed(local, op.discordUsername);
+                changes.publish(ChangeFeed::Kind::Used, shard.keys.at(local));
+            }
+            else if (!shard.keys.at(local).getIsUsed()) {
+                outcome = BatchOutcome::AlreadyUnused;
+            }
+            else {
+                shard.keys.markKeyAsUnused(local);
+                shard.drainedTypes &= ~typeBit(shard.keys.at(local).getKeyType());
+                changes.publish(ChangeFeed::Kind::Unused, shard.keys.at(local));
+            }
+
+            if (outcome == BatchOutcome::Applied && !fullSave) {
+                // Tickets grow, so waiting for the last one covers the whole batch
+                uint64_t ticket = persistKey(shard.keys.at(local));
+                fullSave = ticket == 0;
+                lastTicket = ticket;
+            }
+            outcomes.push_back(outcome);
+        }
+    }
+
+    if (fullSave) {
+        saveKeys();
+    }
+    else if (lastTicket != 0) {
+        commit(lastTicket);
+    }
+    return outcomes;
+}
+
+ImportReport KeyManager::importKeysFromFile(const std::string& filename, KeyType keyType) {
+    ImportReport report;
+
     try {
-        auto importedKeysValues = KeyImporter::importFromFile(filename);
-        int newKeysCount = 0;
-
-        for (const auto& keyValue : importedKeysValues) {
-            if (!keyValue.empty()) {
-                // Create a Key object with the specified type
-                Key key(keyValue, keyType);
-
-                size_t previousSize = m_keyCollection.size();
-                m_keyCollection.addKey(key);
-                if (m_keyCollection.size() > previousSize) {
-                    newKeysCount++;
+        // Trimming, validation and in-file deduplication run in parallel without the lock
+        auto importedKeysValues = KeyImporter::importFromFile(filename, report);
+        auto started = std::chrono::steady_clock::now();
+
+        {
+            auto orderLock = writeLock(orderMutex);
+            std::vector<std::unique_lock<std::shared_mutex>> shardLocks;
+            for (auto& shard : shards) {
+                shardLocks.push_back(writeLock(shard->mutex));
+                shard->keys.reserve(shard->keys.size() + importedKeysValues.size() / shards.size() + 16);
+            }
+            order.reserve(order.size() + importedKeysValues.size());
+
+            uint8_t state = Key::packState(keyType, false);
+            for (const auto& keyValue : importedKeysValues) {
+                // Keys already in the collection are rejected by their shard's hash index
+                if (addLocked(shardIndexOf(keyValue), KeyView(keyValue, state, std::string_view()))) {
+                    report.imported++;
+                }
+                else {
+                    report.duplicates++;
                 }
             }
         }
 
-        if (newKeysCount > 0) {
-            std::cout << "Imported " << newKeysCount << " new keys of type " <<
-                Key(std::string(), keyType).getKeyTypeName() << "." << std::endl;
+        // One persist for the whole import, once the locks are released
+        if (report.imported > 0) {
             saveKeys();
         }
+
+        report.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        if (report.imported > 0) {
+            std::cout << "Imported " << report.imported << " new keys of type " <<
+                Key::typeName(keyType) << "." << std::endl;
+        }
         else {
             std::cout << "No new keys imported." << std::endl;
         }
+        std::cout << "Read " << report.lines << " lines in " << report.seconds << " s ("
+            << static_cast<size_t>(report.linesPerSecond()) << " lines/s): "
+            << report.imported << " imported, " << report.duplicates << " duplicates, "
+            << report.rejected << " rejected." << std::endl;
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
+
+    return report;
 }
 
 void KeyManager::displayKeys() const {
-    if (m_keyCollection.size() == 0) {
+    if (keyCount() == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
 
     std::cout << "\n--- KEY LIST ---" << std::endl;
-    std::cout << "Index | Key | Type | Status | Discord Username" << std::endl;
+    std::cout << "ID | Key | Type | Status | Discord Username" << std::endl;
     std::cout << "-----------------------------------------------------" << std::endl;
 
-    auto keys = m_keyCollection.getAllKeys();
-    for (size_t i = 0; i < keys.size(); i++) {
-        std::cout << i + 1 << " | "
-            << keys[i].getKeyValue() << " | "
-            << keys[i].getKeyTypeName() << " | "
-            << (keys[i].getIsUsed() ? "Used" : "Available") << " | "
-            << keys[i].getDiscordUsername() << std::endl;
-    }
+    forEachKey(KeyFilter(), [](size_t id, const KeyView& key) {
+        std::cout << id << " | "
+            << key.getKeyValue() << " | "
+            << key.getKeyTypeName() << " | "
+            << (key.getIsUsed() ? "Used" : "Available") << " | "
+            << key.getDiscordUsername() << std::endl;
+    });
     std::cout << "-----------------------------------------------------" << std::endl;
 }
 
 void KeyManager::displayKeysByType(KeyType keyType) const {
-    if (m_keyCollection.size() == 0) {
+    if (keyCount() == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
 
-    // Get all keys of the specified type
-    auto allKeys = m_keyCollection.getAllKeys();
-    std::vector<Key> filteredKeys;
-
-    for (const auto& key : allKeys) {
-        if (key.getKeyType() == keyType) {
-            filteredKeys.push_back(key);
-        }
-    }
-
-    if (filteredKeys.empty()) {
-        std::cout << "No keys found with type " << Key(std::string(), keyType).getKeyTypeName() << std::endl;
+    if (getStats().totalOf(keyType) == 0) {
+        std::cout << "No keys found with type " << Key::typeName(keyType) << std::endl;
         return;
     }
 
-    std::cout << "\n--- " << Key(std::string(), keyType).getKeyTypeName() << " KEYS ---" << std::endl;
-    std::cout << "Index | Key | Status | Discord Username" << std::endl;
+    std::cout << "\n--- " << Key::typeName(keyType) << " KEYS ---" << std::endl;
+    std::cout << "ID | Key | Status | Discord Username" << std::endl;
     std::cout << "-----------------------------------------------------" << std::endl;
 
-    for (size_t i = 0; i < filteredKeys.size(); i++) {
-        std::cout << i + 1 << " | "
-            << filteredKeys[i].getKeyValue() << " | "
-            << (filteredKeys[i].getIsUsed() ? "Used" : "Available") << " | "
-            << filteredKeys[i].getDiscordUsername() << std::endl;
-    }
+    KeyFilter filter;
+    filter.type = keyType;
+    forEachKey(filter, [](size_t id, const KeyView& key) {
+        std::cout << id << " | "
+            << key.getKeyValue() << " | "
+            << (key.getIsUsed() ? "Used" : "Available") << " | "
+            << key.getDiscordUsername() << std::endl;
+    });
     std::cout << "-----------------------------------------------------" << std::endl;
 }
 
 void KeyManager::markKeyAsUsed() {
-    if (m_keyCollection.size() == 0) {
+    if (keyCount() == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
 
     displayKeys();
 
-    int index;
-    std::cout << "Enter the index of the key to mark as used: ";
+    long long id;
+    std::cout << "Enter the ID of the key to mark as used: ";
 
     // Safely get user input
     try {
-        std::cin >> index;
+        std::cin >> id;
         std::cin.ignore(); // Clear the newline character
 
         if (std::cin.fail()) {
@@ -140,16 +600,14 @@ void KeyManager::markKeyAsUsed() {
         return;
     }
 
-    if (index < 1 || index > static_cast<int>(m_keyCollection.size())) {
-        std::cout << "Invalid index." << std::endl;
+    std::optional<Key> found = id >= 0 ? getKeyById(static_cast<uint64_t>(id)) : std::nullopt;
+    if (!found) {
+        std::cout << "Invalid ID." << std::endl;
         return;
     }
 
-    // Adjust index to 0-based
-    index--;
-
     try {
-        const Key& key = m_keyCollection.at(index);
+        const Key& key = *found;
         if (key.getIsUsed()) {
             std::cout << "This key is already marked as used by: " << key.getDiscordUsername() << std::endl;
             std::cout << "Do you want to update the Discord username? (y/n): ";
@@ -166,10 +624,17 @@ void KeyManager::markKeyAsUsed() {
         std::cout << "Enter Discord username: ";
         std::getline(std::cin, username);
 
-        m_keyCollection.markKeyAsUsed(index, username);
+        if (!KeyImporter::isValidUsername(username)) {
+            std::cout << "Invalid username." << std::endl;
+            return;
+        }
+
+        if (!markKeyById(key.getId(), username)) {
+            std::cout << "Key could not be updated." << std::endl;
+            return;
+        }
 
         std::cout << "Key marked as used by " << username << std::endl;
-        saveKeys();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -177,19 +642,19 @@ void KeyManager::markKeyAsUsed() {
 }
 
 void KeyManager::markKeyAsUnused() {
-    if (m_keyCollection.size() == 0) {
+    if (keyCount() == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
 
     displayKeys();
 
-    int index;
-    std::cout << "Enter the index of the key to mark as unused: ";
+    long long id;
+    std::cout << "Enter the ID of the key to mark as unused: ";
 
     // Safely get user input
     try {
-        std::cin >> index;
+        std::cin >> id;
 
         if (std::cin.fail()) {
             std::cin.clear(); // Clear the error flag
@@ -202,18 +667,19 @@ void KeyManager::markKeyAsUnused() {
         return;
     }
 
-    if (index < 1 || index > static_cast<int>(m_keyCollection.size())) {
-        std::cout << "Invalid index." << std::endl;
+    std::optional<Key> found = id >= 0 ? getKeyById(static_cast<uint64_t>(id)) : std::nullopt;
+    if (!found) {
+        std::cout << "Invalid ID." << std::endl;
         return;
     }
 
-    // Adjust index to 0-based
-    index--;
-
     try {
-        m_keyCollection.markKeyAsUnused(index);
+        const Key& key = *found;
+        if (!markKeyAsUnusedById(key.getId())) {
+            std::cout << "This key is not marked as used." << std::endl;
+            return;
+        }
         std::cout << "Key marked as unused." << std::endl;
-        saveKeys();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -221,7 +687,7 @@ void KeyManager::markKeyAsUnused() {
 }
 
 void KeyManager::searchByDiscordUsername() const {
-    if (m_keyCollection.size() == 0) {
+    if (keyCount() == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
@@ -231,91 +697,127 @@ void KeyManager::searchByDiscordUsername() const {
     std::cout << "Enter Discord username to search for: ";
     std::getline(std::cin, username);
 
-    auto results = m_keyCollection.searchByDiscordUsername(username);
-
     std::cout << "\n--- SEARCH RESULTS ---" << std::endl;
 
-    if (results.empty()) {
-        std::cout << "No keys found for the specified Discord username." << std::endl;
-    }
-    else {
-        std::cout << "Key | Type | Status | Discord Username" << std::endl;
-        std::cout << "-----------------------------------------------------" << std::endl;
-
-        for (const auto& key : results) {
-            std::cout << key.getKeyValue() << " | "
-                << key.getKeyTypeName() << " | "
-                << (key.getIsUsed() ? "Used" : "Available") << " | "
-                << key.getDiscordUsername() << std::endl;
+    bool found = false;
+    forEachKeyOfUser(username, true, [&found](size_t, const KeyView& key) {
+        if (!found) {
+            std::cout << "Key | Type | Status | Discord Username" << std::endl;
+            std::cout << "-----------------------------------------------------" << std::endl;
+            found = true;
         }
+        std::cout << key.getKeyValue() << " | "
+            << key.getKeyTypeName() << " | "
+            << (key.getIsUsed() ? "Used" : "Available") << " | "
+            << key.getDiscordUsername() << std::endl;
+    });
+
+    if (!found) {
+        std::cout << "No keys found for the specified Discord username." << std::endl;
     }
 
     std::cout << "-----------------------------------------------------" << std::endl;
 }
 
 void KeyManager::displayKeyStatistics() const {
-    if (m_keyCollection.size() == 0) {
+    KeyStats stats = getStats();
+    size_t totalKeys = stats.totalKeys();
+
+    if (totalKeys == 0) {
         std::cout << "No keys available." << std::endl;
         return;
     }
 
-    auto allKeys = m_keyCollection.getAllKeys();
-
-    // Count keys by type
-    std::map<KeyType, int> typeCounts;
-    std::map<KeyType, int> usedTypeCounts;
-
-    for (const auto& key : allKeys) {
-        typeCounts[key.getKeyType()]++;
-        if (key.getIsUsed()) {
-            usedTypeCounts[key.getKeyType()]++;
-        }
-    }
-
     std::cout << "\n--- KEY STATISTICS ---" << std::endl;
-    std::cout << "Total keys: " << allKeys.size() << std::endl;
+    std::cout << "Total keys: " << totalKeys << std::endl;
 
     // Display stats for each key type
     const KeyType types[] = { KeyType::Day, KeyType::Week, KeyType::Month, KeyType::Lifetime };
 
     for (const auto& type : types) {
-        std::string typeName = Key(std::string(), type).getKeyTypeName();
-        int total = typeCounts[type];
-        int used = usedTypeCounts[type];
-        int available = total - used;
+        std::string_view typeName = Key::typeName(type);
+        size_t total = stats.totalOf(type);
+        size_t used = stats.usedOf(type);
+        size_t available = stats.availableOf(type);
 
         if (total > 0) {
             std::cout << "\n" << typeName << " keys:" << std::endl;
             std::cout << "  Total: " << total << std::endl;
-            std::cout << "  Used: " << used << " (" << (total > 0 ? (used * 100 / total) : 0) << "%)" << std::endl;
-            std::cout << "  Available: " << available << " (" << (total > 0 ? (available * 100 / total) : 0) << "%)" << std::endl;
+            std::cout << "  Used: " << used << " (" << (used * 100 / total) << "%)" << std::endl;
+            std::cout << "  Available: " << available << " (" << (available * 100 / total) << "%)" << std::endl;
         }
     }
 
-    int totalUsed = usedTypeCounts[KeyType::Day] +
-        usedTypeCounts[KeyType::Week] +
-        usedTypeCounts[KeyType::Month] +
-        usedTypeCounts[KeyType::Lifetime];
-
-    int totalAvailable = allKeys.size() - totalUsed;
+    size_t totalUsed = stats.usedKeys();
+    size_t totalAvailable = stats.availableKeys();
 
     std::cout << "\nTotal used keys: " << totalUsed;
-    if (allKeys.size() > 0) {
-        std::cout << " (" << (totalUsed * 100 / allKeys.size()) << "%)";
-    }
+    std::cout << " (" << (totalUsed * 100 / totalKeys) << "%)";
     std::cout << std::endl;
 
     std::cout << "Total available keys: " << totalAvailable;
-    if (allKeys.size() > 0) {
-        std::cout << " (" << (totalAvailable * 100 / allKeys.size()) << "%)";
-    }
+    std::cout << " (" << (totalAvailable * 100 / totalKeys) << "%)";
     std::cout << std::endl;
 }
 
-void KeyManager::saveKeys() {
+KeyStats KeyManager::getStats() const {
+    KeyStats stats;
+    for (const auto& shard : shards) {
+        auto lock = readLock(shard->mutex);
+        stats += shard->keys.getStats();
+    }
+    return stats;
+}
+
+bool KeyManager::verifyStats() const {
+    // Each shard is checked under its own lock, so its counters and recount see the same keys
+    KeyStats counted;
+    KeyStats recounted;
+    for (const auto& shard : shards) {
+        auto lock = readLock(shard->mutex);
+        counted += shard->keys.getStats();
+        recounted += shard->keys.recountStats();
+    }
+
+    if (counted == recounted) {
+        return true;
+    }
+
+    const KeyType types[] = { KeyType::Day, KeyType::Week, KeyType::Month, KeyType::Lifetime };
+    for (const auto& type : types) {
+        if (counted.totalOf(type) != recounted.totalOf(type) || counted.usedOf(type) != recounted.usedOf(type)) {
+            std::cerr << "Statistics mismatch for " << Key::typeName(type) << " keys: counters say "
+                << counted.usedOf(type) << "/" << counted.totalOf(type) << " used, recount says "
+                << recounted.usedOf(type) << "/" << recounted.totalOf(type) << std::endl;
+        }
+    }
+    return false;
+}
+
+KeySnapshot KeyManager::captureSnapshot() const {
+    // Only the raw records are copied; rebuilding a KeyCollection here would
+    // hash every value and index every username just to serialize them again
+    KeySnapshot snapshot;
+    snapshot.reserve(keyCount());
+    forEachKey(KeyFilter(), [&snapshot](size_t, const KeyView& key) {
+        snapshot.add(key);
+    });
+    return snapshot;
+}
+
+void KeyManager::saveKeys(bool onlyIfCheckpointDue) {
     try {
-        std::string serialized = m_keyCollection.serialize();
-        if (storage->saveKeys(serialized)) {
+        // One save at a time, each capturing the state as of its own start
+        std::lock_guard<std::mutex> saveLock(saveMutex);
+        if (onlyIfCheckpointDue && !storage->checkpointDue()) {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool saved = storage->saveSnapshot([this]() { return captureSnapshot(); });
+        metrics.saveDuration.observe(std::chrono::steady_clock::now() - start);
+
+        if (saved) {
             std::cout << "Keys saved successfully!" << std::endl;
         }
         else {
@@ -325,4 +827,67 @@ void KeyManager::saveKeys() {
     catch (const std::exception& e) {
         std::cerr << "Error saving keys: " << e.what() << std::endl;
     }
+}
+
+uint64_t KeyManager::persistKey(const KeyView& key) {
+    try {
+        return storage->appendRecord(key);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving keys: " << e.what() << std::endl;
+        return 0;
+    }
+}
+
+void KeyManager::commit(uint64_t ticket) {
+    if (ticket == 0) {
+        // The storage cannot append single records, so rewrite the snapshot
+        saveKeys();
+        return;
+    }
+
+    // storage is set once at construction, so this needs no lock
+    if (!storage->waitForCommit(ticket)) {
+        std::cerr << "Error: Failed to write key change to the journal." << std::endl;
+    }
+
+    // Fold the journal into a fresh snapshot once it has grown large enough
+    if (storage->checkpointDue()) {
+        saveKeys(true);
+    }
+}
+
+bool KeyManager::flush() {
+    // Changes that fell back to a full save were written before their caller returned
+    return storage->flush();
+}
+
+void KeyManager::configurePersistence(std::chrono::microseconds commitWindow, size_t maxBatchSize) {
+    storage->configureGroupCommit(commitWindow, maxBatchSize);
+}
+
+bool KeyManager::getCommitStats(CommitStats& stats) const {
+    return storage->getCommitStats(stats);
+}
+
+const KeyManagerMetrics& KeyManager::getMetrics() const {
+    return metrics;
+}
+
+ChangeFeed& KeyManager::getChangeFeed() {
+    return changes;
+}
+
+uint64_t KeyManager::getSnapshotBytesWritten() const {
+    return storage->getBytesWritten();
+}
+
+size_t KeyManager::memoryUsage() const {
+    auto orderLock = readLock(orderMutex);
+    size_t bytes = order.capacity() * sizeof(IdEntry);
+    for (const auto& shard : shards) {
+        auto lock = readLock(shard->mutex);
+        bytes += shard->keys.memoryUsage();
+    }
+    return bytes;
 }
\ No newline at end of file
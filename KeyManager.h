@@ -1,65 +1,222 @@
 #ifndef KEYMANAGER_H
 #define KEYMANAGER_H
 
+#include "ChangeFeed.h"
 #include "KeyCollection.h"
 #include "IKeyStorage.h"
+#include "KeyImporter.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-// KeyManager class to orchestrate the key management system
+// Lock and save timings for the metrics endpoint, recorded with atomics only
+struct KeyManagerMetrics {
+    LatencyHistogram readLockWait;   // Waiting for a key lock in shared mode
+    LatencyHistogram writeLockWait;  // Waiting for a key lock exclusively
+    LatencyHistogram saveDuration;   // Time in saveKeys, including capturing the snapshot
+};
+
+// One change in a batch; value names the key for every kind, type is only read by Add
+// and discordUsername only by Use
+struct BatchOperation {
+    enum class Kind { Add, Use, Unuse };
+
+    Kind kind;
+    std::string value;
+    KeyType type = KeyType::Day;
+    std::string discordUsername;
+};
+
+enum class BatchOutcome {
+    Applied,
+    AlreadyExists,  // Add of a key already in the collection
+    NotFound,       // Use or Unuse of a key that does not exist
+    AlreadyUnused   // Unuse of a key that is not in use
+};
+
+// KeyManager class to orchestrate the key management system.
+// Keys are split into shards by a hash of their value. Each shard is a
+// KeyCollection with its own lock and its own free lists, so claims and
+// changes by value lock a single shard and writers on different shards run
+// in parallel. Every key has a permanent id, handed out in creation order and
+// stored with the key in the database. A table sorted by id and guarded by
+// orderMutex maps each id to its shard and slot; only adding keys writes to it,
+// and ids of keys that are gone stay unused. Ids are dense unless a database
+// brought gaps with it, and dense ids are found without a search. Operations spanning shards take
+// orderMutex before any shard lock and shard locks in ascending order.
+// Waiting for the journal write to become durable happens after the locks are
+// released, so concurrent writers share one group commit instead of queuing
+// behind each other's fsync.
 class KeyManager {
+public:
+    static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
 private:
-    KeyCollection m_keyCollection;
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        KeyCollection keys;  // Each key carries its id
+
+        // One bit per key type the shard ran out of, so claims skip drained shards without
+        // locking them. Set and cleared under the lock; a stale read only skips or visits once.
+        std::atomic<uint32_t> drainedTypes{ 0 };
+    };
+
+    static uint32_t typeBit(KeyType keyType);
+
+    struct Location {
+        uint32_t shard;
+        uint32_t local;
+    };
+
+    struct IdEntry {
+        uint64_t id;
+        Location location;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    mutable std::shared_mutex orderMutex;
+    std::vector<IdEntry> order;  // Every key's id with its shard and local index, ascending by id
+    uint64_t nextId = 0;         // One past the highest id ever handed out or loaded
+
+    // Position in order of the first entry with an id of at least id
+    size_t orderPosition(uint64_t id) const;
+
+    // Every change is published while its shard is still locked; the feed numbers them
+    ChangeFeed changes;
+
     std::unique_ptr<IKeyStorage> storage;
+    std::mutex saveMutex;
+    mutable KeyManagerMetrics metrics;
+
+    void createShards(size_t shardCount);
+    size_t shardIndexOf(std::string_view keyValue) const;
+
+    // Acquire a key lock, recording how long the caller waited (uncontended acquisitions count as zero)
+    std::shared_lock<std::shared_mutex> readLock(std::shared_mutex& mutex) const;
+    std::unique_lock<std::shared_mutex> writeLock(std::shared_mutex& mutex) const;
+
+    // Shared locks on every shard, in ascending order
+    std::vector<std::shared_lock<std::shared_mutex>> readLockAll() const;
+
+    // Add a new key under the next id, with orderMutex and the shard's lock both held
+    // exclusively by the caller. The key's own id, if any, is ignored.
+    bool addLocked(size_t shardIndex, KeyView key);
+
+    // Shard and slot of a key id, if a key has it. Slots never move, so the result
+    // stays valid after orderMutex is released.
+    std::optional<Location> locate(uint64_t id) const;
+
+    // Mark the key in a slot while its shard is locked exclusively, returning the
+    // journal ticket through ticket (see persistKey)
+    bool markUsedLocked(Shard& shard, size_t local, const std::string& discordUsername, uint64_t& ticket);
+    bool markUnusedLocked(Shard& shard, size_t local, uint64_t& ticket);
+
+    // Flat copy of every key in id order, taken under shared locks on all shards
+    KeySnapshot captureSnapshot() const;
 
-    void saveKeys();
+    void loadKeys();
+
+    // Rewrite the snapshot; with onlyIfCheckpointDue, only if the journal asks for a checkpoint.
+    // Must be called without holding any key lock.
+    void saveKeys(bool onlyIfCheckpointDue = false);
+
+    // Journal a single mutated key while its shard is still locked. Returns the commit
+    // ticket, or 0 if the storage cannot append records and needs a full save instead.
+    uint64_t persistKey(const KeyView& key);
+
+    // Once the locks are released: wait for the ticket's journal batch (reporting a
+    // failed write), or save everything for ticket 0, and checkpoint when due
+    void commit(uint64_t ticket);
+
+    size_t keyCount() const;
 
 public:
     KeyManager();
 
-    // Added method to get all keys from the collection
-    std::vector<Key> getAllKeys() const {
-        return m_keyCollection.getAllKeys();
-    }
-
-    // Added method to add a key to the collection
-    void addKey(const Key& key) {
-        m_keyCollection.addKey(key);
-        saveKeys();
-    }
-
-    // Added method to mark a key as used by its value
-    bool markKeyByValue(const std::string& keyValue, const std::string& discordUsername) {
-        auto keys = m_keyCollection.getAllKeys();
-        for (size_t i = 0; i < keys.size(); i++) {
-            if (keys[i].getKeyValue() == keyValue) {
-                bool result = m_keyCollection.markKeyAsUsed(i, discordUsername);
-                if (result) saveKeys();
-                return result;
-            }
-        }
-        return false;
-    }
-
-    bool markKeyAsUnusedByValue(const std::string& keyValue) {
-        auto keys = m_keyCollection.getAllKeys();
-        for (size_t i = 0; i < keys.size(); i++) {
-            if (keys[i].getKeyValue() == keyValue && keys[i].getIsUsed()) {
-                bool result = m_keyCollection.markKeyAsUnused(i);
-                if (result) saveKeys();
-                return result;
-            }
-        }
-        return false;
-    }
-
-    void importKeysFromFile(const std::string& filename, KeyType keyType);
+    // Use a specific storage backend instead of the database in AppData
+    explicit KeyManager(std::unique_ptr<IKeyStorage> keyStorage, size_t shardCount = DEFAULT_SHARD_COUNT);
+
+    // Visit the matching keys in id order, under shared locks on every shard. The
+    // visitor must not call back into the KeyManager.
+    void forEachKey(const KeyFilter& filter, const KeyVisitor& visit) const;
+
+    // Visit up to limit matching keys with ids from cursor on, the same way. Returns the
+    // id to continue from, or KeyCollection::npos at the end.
+    size_t forEachKeyPage(size_t cursor, size_t limit, const KeyFilter& filter, const KeyVisitor& visit) const;
+
+    // Visit the keys held by a username in id order, found through the username indexes.
+    // Exact match by default, or every username containing it when substring is set.
+    void forEachKeyOfUser(const std::string& username, bool substring, const KeyVisitor& visit) const;
+
+    // Copy of the key with an id, through the id table
+    std::optional<Key> getKeyById(uint64_t id) const;
+
+    // The key with a value paired with its id, found through its shard's hash index
+    std::optional<std::pair<size_t, Key>> findKey(const std::string& keyValue) const;
+
+    bool addKey(const Key& key);
+
+    // Mark a key as used (or unused) by its value; only the key's shard is locked
+    bool markKeyByValue(const std::string& keyValue, const std::string& discordUsername);
+    bool markKeyAsUnusedByValue(const std::string& keyValue);
+
+    // The same by id, found through the id table without copying or scanning anything
+    bool markKeyById(uint64_t id, const std::string& discordUsername);
+    bool markKeyAsUnusedById(uint64_t id);
+
+    // Hand out the next available key of a type, or nothing if the type is out of stock.
+    // Each thread starts at its own shard and only moves on when that shard has none left.
+    std::optional<Key> claimKey(KeyType keyType, const std::string& discordUsername);
+
+    // Apply a batch of changes in order under one acquisition of the locks, then persist
+    // them together: every change joins the same journal group commit (or one full save).
+    // Returns an outcome per operation; failed operations do not stop the rest.
+    std::vector<BatchOutcome> applyBatch(const std::vector<BatchOperation>& operations);
+
+    // Bulk import of a key file: one lock and one persist for the whole file
+    ImportReport importKeysFromFile(const std::string& filename, KeyType keyType);
     void displayKeys() const;
     void displayKeysByType(KeyType keyType) const;
     void markKeyAsUsed();
     void markKeyAsUnused();
     void searchByDiscordUsername() const;
     void displayKeyStatistics() const;
+
+    // Counts every change to the keys since startup. Read before a response is rendered,
+    // it never claims more than the response holds, so it can serve as an ETag.
+    uint64_t getVersion() const;
+
+    // Recent changes by version, for clients mirroring the keys
+    ChangeFeed& getChangeFeed();
+
+    // Per type counts, summed over the shards
+    KeyStats getStats() const;
+
+    // Self-check: recount every key and compare with the running counters, reporting mismatches
+    bool verifyStats() const;
+
+    // Block until every change made so far is durable; false if a journal write failed
+    bool flush();
+
+    // Group commit tuning and counters of the journal (false if the storage does not batch)
+    void configurePersistence(std::chrono::microseconds commitWindow, size_t maxBatchSize);
+    bool getCommitStats(CommitStats& stats) const;
+
+    // Lock wait and save timings, plus the bytes the storage has written to its snapshot so far
+    const KeyManagerMetrics& getMetrics() const;
+    uint64_t getSnapshotBytesWritten() const;
+
+    // Bytes held by the shards and the id table
+    size_t memoryUsage() const;
 };
 
 #endif // KEYMANAGER_H
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "KeySnapshot.h"
+#include "KeyCollection.h"
+
+KeySnapshot::KeySnapshot(const KeyCollection& collection) {
+    reserve(collection.size());
+    for (size_t i = 0; i < collection.size(); i++) {
+        add(collection.at(i));
+    }
+}
+
+void KeySnapshot::reserve(size_t count, size_t bytes) {
+    records.reserve(count);
+    arena.reserve(bytes);
+}
+
+void KeySnapshot::add(const KeyView& key) {
+    Record record;
+    record.id = key.getId();
+    record.state = key.getState();
+    record.valueOffset = arena.size();
+    record.valueLength = static_cast<uint32_t>(key.getKeyValue().size());
+    arena += key.getKeyValue();
+    record.usernameOffset = arena.size();
+    record.usernameLength = static_cast<uint32_t>(key.getDiscordUsername().size());
+    arena += key.getDiscordUsername();
+    records.push_back(record);
+}
+
+size_t KeySnapshot::size() const {
+    return records.size();
+}
+
+KeyView KeySnapshot::at(size_t index) const {
+    const Record& record = records[index];
+    return KeyView(std::string_view(arena.data() + record.valueOffset, record.valueLength), record.state,
+        std::string_view(arena.data() + record.usernameOffset, record.usernameLength), record.id);
+}
+
+std::string KeySnapshot::serialize() const {
+    std::string serialized;
+    serialized.reserve(arena.size() + records.size() * 8);
+    for (size_t i = 0; i < records.size(); i++) {
+        at(i).serializeTo(serialized);
+        serialized += '\n';
+    }
+    return serialized;
+}
@@ -0,0 +1,46 @@
+#ifndef KEYSNAPSHOT_H
+#define KEYSNAPSHOT_H
+
+#include "Key.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class KeyCollection;
+
+// Flat copy of keys for writing a snapshot: one record per key, in the order
+// added, with values and usernames packed into a single arena. Unlike a
+// KeyCollection it keeps no value hash table, free lists or username index,
+// so capturing one costs a copy of the key data and nothing more.
+class KeySnapshot {
+private:
+    struct Record {
+        uint64_t id;
+        size_t valueOffset;
+        size_t usernameOffset;
+        uint32_t valueLength;
+        uint32_t usernameLength;
+        uint8_t state;
+    };
+
+    std::vector<Record> records;
+    std::string arena;
+
+public:
+    KeySnapshot() = default;
+
+    // Every key of the collection, in index order
+    explicit KeySnapshot(const KeyCollection& collection);
+
+    // Room for count keys whose values and usernames take bytes in total
+    void reserve(size_t count, size_t bytes = 0);
+    void add(const KeyView& key);
+
+    size_t size() const;
+    KeyView at(size_t index) const;
+
+    // Same text format as KeyCollection::serialize
+    std::string serialize() const;
+};
+
+#endif // KEYSNAPSHOT_H
@@ -0,0 +1,138 @@
+#include "MappedFile.h"
+#include "WindowsCompatibilityFix.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile() : mappedData(nullptr), mappedSize(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {}
+#else
+MappedFile::MappedFile() : mappedData(nullptr), mappedSize(0), fileDescriptor(-1) {}
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize)) {
+        close();
+        return false;
+    }
+
+    // Windows refuses to map empty files
+    if (fileSize.QuadPart == 0) {
+        return true;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == nullptr) {
+        close();
+        return false;
+    }
+
+    mappedData = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mappedData == nullptr) {
+        close();
+        return false;
+    }
+
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mappedData != nullptr) {
+        UnmapViewOfFile(mappedData);
+    }
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+bool MappedFile::isOpen() const {
+    return fileHandle != INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+        return false;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fileDescriptor, &fileInfo) != 0) {
+        close();
+        return false;
+    }
+
+    // mmap refuses zero-length mappings
+    if (fileInfo.st_size == 0) {
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(fileInfo.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapping == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    madvise(mapping, static_cast<size_t>(fileInfo.st_size), MADV_SEQUENTIAL);
+    mappedData = static_cast<const char*>(mapping);
+    mappedSize = static_cast<size_t>(fileInfo.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (mappedData != nullptr) {
+        munmap(const_cast<char*>(mappedData), mappedSize);
+    }
+    if (fileDescriptor >= 0) {
+        ::close(fileDescriptor);
+    }
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    fileDescriptor = -1;
+}
+
+bool MappedFile::isOpen() const {
+    return fileDescriptor >= 0;
+}
+#endif
+
+const char* MappedFile::data() const {
+    return mappedData;
+}
+
+size_t MappedFile::size() const {
+    return mappedSize;
+}
+
+std::string_view MappedFile::view() const {
+    return mappedData != nullptr ? std::string_view(mappedData, mappedSize) : std::string_view();
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* mappedData;
+    size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map the file; an existing but empty file opens with size 0
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const;
+    const char* data() const;
+    size_t size() const;
+    std::string_view view() const;
+};
+
+#endif // MAPPEDFILE_H
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+void LatencyHistogram::observe(std::chrono::nanoseconds elapsed) {
+    uint64_t nanos = elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count()) : 0;
+
+    // Buckets hold their own samples only; appendPrometheus makes them cumulative
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        if (nanos <= BUCKET_LIMITS[i]) {
+            buckets[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (nanos > 0) {
+        totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    }
+    observations.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return observations.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::appendPrometheus(std::string& out, std::string_view name, std::string_view labels) const {
+    std::string bucketName = std::string(name) + "_bucket";
+    std::string prefix = labels.empty() ? std::string() : std::string(labels) + ",";
+
+    // Read the total first so no bucket can exceed +Inf
+    uint64_t total = observations.load(std::memory_order_relaxed);
+    uint64_t cumulative = 0;
+    char limit[32];
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        std::snprintf(limit, sizeof(limit), "le=\"%g\"", BUCKET_LIMITS[i] / 1e9);
+        Prometheus::appendSample(out, bucketName, prefix + limit, std::min(cumulative, total));
+    }
+    Prometheus::appendSample(out, bucketName, prefix + "le=\"+Inf\"", total);
+    Prometheus::appendSample(out, std::string(name) + "_sum", labels, totalNanos.load(std::memory_order_relaxed) / 1e9);
+    Prometheus::appendSample(out, std::string(name) + "_count", labels, total);
+}
+
+void Prometheus::appendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void Prometheus::appendSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value) {
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void Prometheus::appendSample(std::string& out, std::string_view name, std::string_view labels, double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.9g", value);
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += number;
+    out += '\n';
+}
\ No newline at end of file
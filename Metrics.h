@@ -0,0 +1,48 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Latency histogram with fixed buckets. Every counter is a relaxed atomic, so
+// any thread can record into it without a lock; readers may see a sample in
+// the count before it shows up in the sum, which Prometheus tolerates.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKET_COUNT = 17;
+
+    // Upper bounds of the buckets in nanoseconds (10us to 2.5s); slower samples only count towards +Inf
+    static constexpr uint64_t BUCKET_LIMITS[BUCKET_COUNT] = {
+        10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+        100000000, 250000000, 500000000, 1000000000, 2500000000
+    };
+
+    void observe(std::chrono::nanoseconds elapsed);
+    uint64_t count() const;
+
+    // Append the _bucket, _sum and _count lines in the Prometheus text format.
+    // labels is the inside of the label set, e.g. route="/api/keys", or empty.
+    void appendPrometheus(std::string& out, std::string_view name, std::string_view labels) const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> totalNanos{ 0 };
+    std::atomic<uint64_t> observations{ 0 };
+};
+
+// Helpers for the Prometheus text exposition format
+class Prometheus {
+public:
+    // # HELP and # TYPE lines introducing a metric family
+    static void appendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+
+    // One sample line: name{labels} value
+    static void appendSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value);
+    static void appendSample(std::string& out, std::string_view name, std::string_view labels, double value);
+};
+
+#endif // METRICS_H
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "ResponseCache.h"
+
+ResponseCache::Slot ResponseCache::keyListSlot(std::optional<KeyType> keyType) {
+    if (!keyType) {
+        return Slot::Keys;
+    }
+    return static_cast<Slot>(static_cast<size_t>(Slot::DailyKeys) + static_cast<size_t>(*keyType) % 4);
+}
+
+const char* ResponseCache::slotName(Slot slot) {
+    static const char* names[] = { "stats", "keys", "dailyKeys", "weeklyKeys", "monthlyKeys", "lifetimeKeys" };
+    return names[static_cast<size_t>(slot)];
+}
+
+ResponseCache::Body ResponseCache::find(Slot slot, uint64_t version, ContentEncoding encoding) {
+    Entry& entry = entries[static_cast<size_t>(slot)];
+    size_t coding = static_cast<size_t>(encoding);
+    Body body;
+    {
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        if (entry.version == version) {
+            body = entry.bodies[coding];
+        }
+    }
+
+    (body ? entry.hits[coding] : entry.misses[coding]).fetch_add(1, std::memory_order_relaxed);
+    return body;
+}
+
+ResponseCache::Body ResponseCache::store(Slot slot, uint64_t version, std::string body, ContentEncoding encoding) {
+    auto shared = std::make_shared<const std::string>(std::move(body));
+    if (shared->size() > MAX_BODY_BYTES) {
+        return shared;
+    }
+
+    // Concurrent misses may render the same version; the first one stored is kept
+    Entry& entry = entries[static_cast<size_t>(slot)];
+    Body replaced[ENCODING_COUNT];  // Freed after the lock is released
+    std::lock_guard<std::mutex> lock(entry.mutex);
+    if (version > entry.version) {
+        for (size_t i = 0; i < ENCODING_COUNT; i++) {
+            replaced[i] = std::move(entry.bodies[i]);
+        }
+        entry.version = version;
+    }
+    Body& cached = entry.bodies[static_cast<size_t>(encoding)];
+    if (version == entry.version && !cached) {
+        cached = shared;
+    }
+    return shared;
+}
+
+uint64_t ResponseCache::hits(Slot slot, ContentEncoding encoding) const {
+    return entries[static_cast<size_t>(slot)].hits[static_cast<size_t>(encoding)].load(std::memory_order_relaxed);
+}
+
+uint64_t ResponseCache::misses(Slot slot, ContentEncoding encoding) const {
+    return entries[static_cast<size_t>(slot)].misses[static_cast<size_t>(encoding)].load(std::memory_order_relaxed);
+}
+
+size_t ResponseCache::memoryUsage() const {
+    size_t bytes = 0;
+    for (const auto& entry : entries) {
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        for (const auto& body : entry.bodies) {
+            if (body) {
+                bytes += body->capacity();
+            }
+        }
+    }
+    return bytes;
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include "HttpCompression.h"
+#include "Key.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Rendered bodies of the read endpoints, each tagged with the KeyManager version it
+// was rendered at. A lookup only hits when the version still matches, so any change
+// to the keys invalidates every entry without the writers doing anything; the stale
+// body is replaced by the next render. Bodies are shared immutable strings, so
+// concurrent requests hand out the same bytes without copying them under the lock.
+// Compressed bodies are kept next to the plain one of the same version, so each
+// version is compressed at most once per coding.
+class ResponseCache {
+public:
+    // Bodies above this size are rendered for every request instead of being kept
+    static constexpr size_t MAX_BODY_BYTES = 128 * 1024 * 1024;
+
+    enum class Slot { Stats, Keys, DailyKeys, WeeklyKeys, MonthlyKeys, LifetimeKeys, Count };
+
+    using Body = std::shared_ptr<const std::string>;
+
+    // Slot of the full /api/keys body, or of /api/keys/type/<int> for a type
+    static Slot keyListSlot(std::optional<KeyType> keyType);
+
+    // Label of a slot in the metrics
+    static const char* slotName(Slot slot);
+
+    // The body rendered at version in a coding, if it is cached; counts a hit or a miss
+    Body find(Slot slot, uint64_t version, ContentEncoding encoding = ContentEncoding::Identity);
+
+    // Keep a body rendered at version, unless one of a later version is already cached.
+    // A newer version drops the bodies of the older one in every coding. Returns the
+    // body either way, so the caller can serve it without another copy.
+    Body store(Slot slot, uint64_t version, std::string body, ContentEncoding encoding = ContentEncoding::Identity);
+
+    uint64_t hits(Slot slot, ContentEncoding encoding) const;
+    uint64_t misses(Slot slot, ContentEncoding encoding) const;
+
+    // Bytes held by the cached bodies
+    size_t memoryUsage() const;
+
+private:
+    static constexpr size_t ENCODING_COUNT = static_cast<size_t>(ContentEncoding::Count);
+
+    struct Entry {
+        mutable std::mutex mutex;
+        uint64_t version = 0;
+        Body bodies[ENCODING_COUNT];  // By coding, all rendered at version
+        std::atomic<uint64_t> hits[ENCODING_COUNT] = {};
+        std::atomic<uint64_t> misses[ENCODING_COUNT] = {};
+    };
+
+    Entry entries[static_cast<size_t>(Slot::Count)];
+};
+
+#endif // RESPONSECACHE_H
\ No newline at end of file
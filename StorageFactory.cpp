@@ -0,0 +1,33 @@
+#include "StorageFactory.h"
+#include "BinarySnapshotStorage.h"
+#include "FileManager.h"
+#include "FileSystemStorage.h"
+#include "JournaledStorage.h"
+#include <filesystem>
+
+std::string StorageFactory::getDatabasePath(StorageFormat format) {
+    return FileManager::getAppDataPath() + (format == StorageFormat::Binary ? "keys.bin" : "keys.csv");
+}
+
+std::string StorageFactory::getJournalPath() {
+    return FileManager::getAppDataPath() + "keys.journal";
+}
+
+StorageFormat StorageFactory::detectFormat() {
+    std::error_code ec;
+    if (std::filesystem::exists(getDatabasePath(StorageFormat::Binary), ec)) {
+        return StorageFormat::Binary;
+    }
+    return StorageFormat::Text;
+}
+
+std::unique_ptr<IKeyStorage> StorageFactory::createSnapshotStorage(StorageFormat format) {
+    if (format == StorageFormat::Binary) {
+        return std::make_unique<BinarySnapshotStorage>(getDatabasePath(format));
+    }
+    return std::make_unique<FileSystemStorage>(getDatabasePath(format));
+}
+
+std::unique_ptr<IKeyStorage> StorageFactory::createStorage() {
+    return std::make_unique<JournaledStorage>(createSnapshotStorage(detectFormat()), getJournalPath());
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef STORAGEFACTORY_H
+#define STORAGEFACTORY_H
+
+#include "IKeyStorage.h"
+#include <memory>
+#include <string>
+
+// Database file formats supported by the storage backends
+enum class StorageFormat {
+    Text,
+    Binary
+};
+
+// StorageFactory class to pick the storage backend for the key database
+class StorageFactory {
+public:
+    static std::string getDatabasePath(StorageFormat format);
+    static std::string getJournalPath();
+
+    // The binary snapshot wins when present, otherwise the text database is used
+    static StorageFormat detectFormat();
+
+    // Snapshot backend only, without the journal
+    static std::unique_ptr<IKeyStorage> createSnapshotStorage(StorageFormat format);
+
+    // Journaled storage over the detected format, as used by KeyManager
+    static std::unique_ptr<IKeyStorage> createStorage();
+};
+
+#endif // STORAGEFACTORY_H
\ No newline at end of file
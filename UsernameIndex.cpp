@@ -0,0 +1,148 @@
+#include "UsernameIndex.h"
+#include <algorithm>
+#include <iterator>
+
+uint32_t UsernameIndex::trigramAt(std::string_view text, size_t pos) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16) |
+        (static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8) |
+        static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+}
+
+UsernameIndex::UsernameIndex() {
+    clear();
+}
+
+uint32_t UsernameIndex::intern(std::string_view username) {
+    if (username.empty()) {
+        return EMPTY_ID;
+    }
+
+    std::string name(username);
+    auto found = userIds.find(name);
+    if (found != userIds.end()) {
+        return found->second;
+    }
+
+    uint32_t id = static_cast<uint32_t>(users.size());
+    users.push_back({ name, {} });
+    userIds.emplace(std::move(name), id);
+
+    // Ids only increase, so appending keeps every posting list sorted
+    for (size_t pos = 0; pos + 3 <= username.size(); pos++) {
+        auto& postings = trigrams[trigramAt(username, pos)];
+        if (postings.empty() || postings.back() != id) {
+            postings.push_back(id);
+        }
+    }
+    return id;
+}
+
+std::string_view UsernameIndex::nameOf(uint32_t id) const {
+    return id < users.size() ? std::string_view(users[id].name) : std::string_view();
+}
+
+void UsernameIndex::add(uint32_t id, uint32_t slot) {
+    if (id == EMPTY_ID || id >= users.size()) {
+        return;
+    }
+
+    users[id].slots.push_back(slot);
+}
+
+void UsernameIndex::remove(uint32_t id, uint32_t slot) {
+    if (id == EMPTY_ID || id >= users.size()) {
+        return;
+    }
+
+    // A user holds few keys, so a linear find with swap-remove is enough
+    auto& slots = users[id].slots;
+    auto it = std::find(slots.begin(), slots.end(), slot);
+    if (it != slots.end()) {
+        *it = slots.back();
+        slots.pop_back();
+    }
+}
+
+void UsernameIndex::clear() {
+    users.clear();
+    userIds.clear();
+    trigrams.clear();
+    users.push_back({ std::string(), {} });
+}
+
+size_t UsernameIndex::memoryUsage() const {
+    size_t bytes = users.capacity() * sizeof(User);
+    for (const auto& user : users) {
+        bytes += user.slots.capacity() * sizeof(uint32_t);
+        if (user.name.capacity() > 15) {
+            bytes += user.name.capacity() + 1;
+        }
+    }
+
+    // Approximate node costs of the two hash maps
+    bytes += userIds.size() * (sizeof(std::string) + sizeof(uint32_t) + 2 * sizeof(void*)) +
+        userIds.bucket_count() * sizeof(void*);
+    bytes += trigrams.bucket_count() * sizeof(void*);
+    for (const auto& trigram : trigrams) {
+        bytes += sizeof(trigram) + 2 * sizeof(void*) + trigram.second.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+std::vector<size_t> UsernameIndex::findExact(const std::string& username) const {
+    auto found = userIds.find(username);
+    if (found == userIds.end()) {
+        return {};
+    }
+
+    const auto& slots = users[found->second].slots;
+    std::vector<size_t> result(slots.begin(), slots.end());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<size_t> UsernameIndex::findContaining(std::string_view fragment) const {
+    std::vector<uint32_t> candidates;
+
+    if (fragment.size() < 3) {
+        // Too short for a trigram, so check every distinct name instead of every key
+        for (uint32_t id = 0; id < users.size(); id++) {
+            if (!users[id].slots.empty()) {
+                candidates.push_back(id);
+            }
+        }
+    }
+    else {
+        // Intersect the posting lists, smallest first
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (size_t pos = 0; pos + 3 <= fragment.size(); pos++) {
+            auto found = trigrams.find(trigramAt(fragment, pos));
+            if (found == trigrams.end()) {
+                return {};
+            }
+            lists.push_back(&found->second);
+        }
+        std::sort(lists.begin(), lists.end(),
+            [](const auto* a, const auto* b) { return a->size() < b->size(); });
+
+        candidates = *lists.front();
+        std::vector<uint32_t> intersection;
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            intersection.clear();
+            std::set_intersection(candidates.begin(), candidates.end(),
+                lists[i]->begin(), lists[i]->end(), std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+    }
+
+    // Sharing all trigrams does not guarantee containment, so verify each name
+    std::vector<size_t> result;
+    for (uint32_t id : candidates) {
+        const User& user = users[id];
+        if (!user.slots.empty() && user.name.find(fragment) != std::string::npos) {
+            result.insert(result.end(), user.slots.begin(), user.slots.end());
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
\ No newline at end of file
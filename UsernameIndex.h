@@ -0,0 +1,57 @@
+#ifndef USERNAMEINDEX_H
+#define USERNAMEINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Intern table and inverted index for Discord usernames.
+// Every distinct username gets an id (0 is the empty name) that KeyCollection
+// stores instead of the string, plus the list of key slots it holds. A trigram
+// index over the names answers substring queries by intersecting posting
+// lists, and exact queries are a single hash lookup. Names whose keys were all
+// released keep their id, so ids stay valid and posting lists only ever grow.
+class UsernameIndex {
+private:
+    struct User {
+        std::string name;
+        std::vector<uint32_t> slots;
+    };
+
+    std::vector<User> users;
+    std::unordered_map<std::string, uint32_t> userIds;
+
+    // Trigram -> ids of the usernames containing it, ascending
+    std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+    static uint32_t trigramAt(std::string_view text, size_t pos);
+
+public:
+    static constexpr uint32_t EMPTY_ID = 0;
+
+    UsernameIndex();
+
+    // Id of a username, registering it on first use
+    uint32_t intern(std::string_view username);
+
+    // Name of an interned id
+    std::string_view nameOf(uint32_t id) const;
+
+    // Record that the key in slot is held by the user (ignored for the empty name)
+    void add(uint32_t id, uint32_t slot);
+    void remove(uint32_t id, uint32_t slot);
+    void clear();
+
+    // Slots held by exactly this username, ascending
+    std::vector<size_t> findExact(const std::string& username) const;
+
+    // Slots whose username contains fragment, ascending
+    std::vector<size_t> findContaining(std::string_view fragment) const;
+
+    // Bytes held by the table, for memory reporting
+    size_t memoryUsage() const;
+};
+
+#endif // USERNAMEINDEX_H
\ No newline at end of file
@@ -2,29 +2,33 @@
 #include "KeyManager.h"
 #include "BackupRestoreUtil.h"
 #include "ApiServer.h"
+#include "Benchmark.h"
+#include "HttpCompression.h"
+#include "JournaledStorage.h"
 #include <iostream>
 #include <string>
 #include <memory>
+#include <vector>
 #include <csignal>
 #include <crow.h>
 
 // Global ApiServer instance to allow signal handling
 std::unique_ptr<ApiServer> apiServer;
 
+// Set by the signal handler and polled by the main thread, which stops the server and
+// returns normally. Locking a mutex or notifying a condition variable is not
+// async-signal-safe, so the handler does nothing else.
+volatile std::sig_atomic_t stopSignalled = 0;
+
 // Signal handler for graceful shutdown
 void signalHandler(int signal) {
-    std::cout << "Received signal " << signal << std::endl;
-    if (apiServer && apiServer->isRunning()) {
-        std::cout << "Stopping API server..." << std::endl;
-        apiServer->stop();
-    }
-    exit(signal);
+    stopSignalled = 1;
 }
 
-// Function to handle command-line arguments for batch operations
-void processCommandLine(int argc, char* argv[]) {
+// Function to handle command-line arguments for batch operations; returns the exit code
+int processCommandLine(int argc, char* argv[]) {
     if (argc < 2) {
-        return; // No command-line arguments, run in interactive mode
+        return 0; // No command-line arguments, run in interactive mode
     }
 
     std::string command = argv[1];
@@ -51,7 +55,7 @@ void processCommandLine(int argc, char* argv[]) {
         catch (const std::exception& e) {
             std::cerr << "Error during import: " << e.what() << std::endl;
         }
-        return;
+        return 0;
     }
 
     if (command == "backup_db" && argc >= 3) {
@@ -63,7 +67,7 @@ void processCommandLine(int argc, char* argv[]) {
         catch (const std::exception& e) {
             std::cerr << "Error during backup: " << e.what() << std::endl;
         }
-        return;
+        return 0;
     }
 
     if (command == "restore_db" && argc >= 3) {
@@ -75,7 +79,7 @@ void processCommandLine(int argc, char* argv[]) {
         catch (const std::exception& e) {
             std::cerr << "Error during restore: " << e.what() << std::endl;
         }
-        return;
+        return 0;
     }
 
     if (command == "repair_db") {
@@ -86,52 +90,220 @@ void processCommandLine(int argc, char* argv[]) {
         catch (const std::exception& e) {
             std::cerr << "Error during repair: " << e.what() << std::endl;
         }
-        return;
+        return 0;
+    }
+
+    if (command == "verify_stats") {
+        // verify_stats
+        try {
+            KeyManager keyManager;
+            if (keyManager.verifyStats()) {
+                std::cout << "Statistics counters are consistent." << std::endl;
+            }
+            else {
+                std::cerr << "Statistics counters do not match a full recount." << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during verification: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "convert_db" && argc >= 3) {
+        // convert_db [text|binary]
+        try {
+            BackupRestoreUtil::convertDatabase(argv[2]);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during conversion: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "benchmark_parse") {
+        // benchmark_parse [key_count]
+        try {
+            size_t keyCount = argc >= 3 ? std::stoul(argv[2]) : 1000000;
+            Benchmark::runParserBenchmark(keyCount);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "benchmark_reads") {
+        // benchmark_reads [key_count] [max_threads]
+        try {
+            size_t keyCount = argc >= 3 ? std::stoul(argv[2]) : 10000;
+            unsigned maxThreads = argc >= 4 ? static_cast<unsigned>(std::stoul(argv[3])) : std::thread::hardware_concurrency();
+            Benchmark::runReadScalingBenchmark(keyCount, maxThreads > 0 ? maxThreads : 1);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "benchmark_claims") {
+        // benchmark_claims [key_count] [max_threads]
+        try {
+            size_t keyCount = argc >= 3 ? std::stoul(argv[2]) : 1000000;
+            unsigned maxThreads = argc >= 4 ? static_cast<unsigned>(std::stoul(argv[3])) : std::thread::hardware_concurrency();
+            Benchmark::runClaimScalingBenchmark(keyCount, maxThreads > 0 ? maxThreads : 1);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "benchmark_memory") {
+        // benchmark_memory [key_count]
+        try {
+            size_t keyCount = argc >= 3 ? std::stoul(argv[2]) : 1000000;
+            Benchmark::runMemoryBenchmark(keyCount);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "generate_db") {
+        // generate_db [output_file] [--keys=N] [--types=d,w,m,l] [--used=R] [--users=N] [--skew=S] [--seed=N]
+        if (argc < 3) {
+            std::cerr << "Usage: generate_db [output_file] [dataset options]" << std::endl;
+            return 0;
+        }
+
+        try {
+            DatasetOptions options;
+            for (int i = 3; i < argc; i++) {
+                if (!options.parseOption(argv[i])) {
+                    std::cerr << "Unknown dataset option: " << argv[i] << std::endl;
+                    return 0;
+                }
+            }
+            Benchmark::writeDataset(options, argv[2]);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error generating database: " << e.what() << std::endl;
+        }
+        return 0;
+    }
+
+    if (command == "benchmark") {
+        // benchmark [--output=benchmark.json] [--repeat=3] [dataset options]
+        try {
+            DatasetOptions options;
+            std::string outputPath = "benchmark.json";
+            unsigned repeat = 3;
+            for (int i = 2; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg.rfind("--output=", 0) == 0) {
+                    outputPath = arg.substr(arg.find('=') + 1);
+                }
+                else if (arg.rfind("--repeat=", 0) == 0) {
+                    repeat = static_cast<unsigned>(std::stoul(arg.substr(arg.find('=') + 1)));
+                }
+                else if (!options.parseOption(arg)) {
+                    std::cerr << "Unknown benchmark option: " << arg << std::endl;
+                    return 0;
+                }
+            }
+            Benchmark::runSuite(options, outputPath, repeat);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        }
+        return 0;
     }
 
     if (command == "start_api") {
-        // start_api [port] [use_https] [cert_file] [key_file]
+        // start_api [port] [use_https] [cert_file] [key_file] [--option=value ...]
         try {
             int port = 8080; // Default port
             bool useHttps = false;
             std::string certFile = "server.crt";
             std::string keyFile = "server.key";
+            std::chrono::microseconds commitWindow = JournaledStorage::DEFAULT_COMMIT_WINDOW;
+            size_t commitMaxBatch = JournaledStorage::DEFAULT_MAX_BATCH_SIZE;
+            size_t compressMinBytes = HttpCompression::DEFAULT_MIN_BYTES;
+            unsigned workers = 0;
+            unsigned idleTimeout = 5;
 
-            if (argc >= 3) {
-                port = std::stoi(argv[2]);
+            // Named options may appear anywhere; the rest are positional
+            std::vector<std::string> args;
+            for (int i = 2; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg.rfind("--commit-window-us=", 0) == 0) {
+                    commitWindow = std::chrono::microseconds(std::stoll(arg.substr(arg.find('=') + 1)));
+                }
+                else if (arg.rfind("--commit-max-batch=", 0) == 0) {
+                    commitMaxBatch = std::stoul(arg.substr(arg.find('=') + 1));
+                }
+                else if (arg.rfind("--workers=", 0) == 0) {
+                    workers = static_cast<unsigned>(std::stoul(arg.substr(arg.find('=') + 1)));
+                }
+                else if (arg.rfind("--idle-timeout-s=", 0) == 0) {
+                    idleTimeout = static_cast<unsigned>(std::stoul(arg.substr(arg.find('=') + 1)));
+                }
+                else if (arg.rfind("--compress-min-bytes=", 0) == 0) {
+                    std::string value = arg.substr(arg.find('=') + 1);
+                    compressMinBytes = value == "off" ? SIZE_MAX : std::stoull(value);
+                }
+                else {
+                    args.push_back(arg);
+                }
             }
 
-            if (argc >= 4) {
-                useHttps = (std::string(argv[3]) == "true" || std::string(argv[3]) == "1");
+            if (args.size() >= 1) {
+                port = std::stoi(args[0]);
             }
 
-            if (argc >= 5) {
-                certFile = argv[4];
+            if (args.size() >= 2) {
+                useHttps = (args[1] == "true" || args[1] == "1");
             }
 
-            if (argc >= 6) {
-                keyFile = argv[5];
+            if (args.size() >= 3) {
+                certFile = args[2];
             }
 
-            // Register signal handlers for graceful shutdown
-            std::signal(SIGINT, signalHandler);
-            std::signal(SIGTERM, signalHandler);
+            if (args.size() >= 4) {
+                keyFile = args[3];
+            }
 
             // Create and start API server
             apiServer = std::make_unique<ApiServer>();
+            apiServer->configurePersistence(commitWindow, commitMaxBatch);
+            apiServer->configureCompression(compressMinBytes);
+            apiServer->configureServer(workers, idleTimeout);
+
+            // Register signal handlers for graceful shutdown, now that there is a server to stop
+            std::signal(SIGINT, signalHandler);
+            std::signal(SIGTERM, signalHandler);
+
             apiServer->start(port, useHttps, certFile, keyFile);
 
             std::cout << "API server started. Press Ctrl+C to stop." << std::endl;
 
-            // Keep the main thread alive until interrupted
-            while (apiServer->isRunning()) {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+            // Sleep until interrupted (or the server fails), then drain, stop and flush
+            while (!stopSignalled && !apiServer->waitForStopRequest(std::chrono::milliseconds(100))) {
+            }
+            apiServer->stop();
+
+            if (apiServer->hasFailed()) {
+                std::cerr << "Error: API server failed, e.g. port " << port << " is already in use." << std::endl;
+                return 1;
             }
         }
         catch (const std::exception& e) {
             std::cerr << "Error starting API server: " << e.what() << std::endl;
+            return 1;
         }
-        return;
+        return 0;
     }
 
     // Unknown command
@@ -141,15 +313,26 @@ void processCommandLine(int argc, char* argv[]) {
     std::cout << "  backup_db [backup_filename]" << std::endl;
     std::cout << "  restore_db [backup_filename]" << std::endl;
     std::cout << "  repair_db" << std::endl;
+    std::cout << "  convert_db [text|binary]" << std::endl;
+    std::cout << "  verify_stats" << std::endl;
+    std::cout << "  benchmark_parse [key_count=1000000]" << std::endl;
+    std::cout << "  benchmark_reads [key_count=10000] [max_threads=cores]" << std::endl;
+    std::cout << "  benchmark_claims [key_count=1000000] [max_threads=cores]" << std::endl;
+    std::cout << "  benchmark_memory [key_count=1000000]" << std::endl;
+    std::cout << "  generate_db [output_file] [--keys=1000000] [--types=40,30,20,10] [--used=0.5]" << std::endl;
+    std::cout << "              [--users=50000] [--skew=1.0] [--seed=42]" << std::endl;
+    std::cout << "  benchmark [--output=benchmark.json] [--repeat=3] [generate_db options]" << std::endl;
     std::cout << "  start_api [port=8080] [use_https=false] [cert_file=server.crt] [key_file=server.key]" << std::endl;
+    std::cout << "            [--commit-window-us=2000] [--commit-max-batch=256] [--compress-min-bytes=1024|off]" << std::endl;
+    std::cout << "            [--workers=cores] [--idle-timeout-s=5]" << std::endl;
+    return 1;
 }
 
 int main(int argc, char* argv[]) {
     try {
         // Check for command-line arguments
         if (argc > 1) {
-            processCommandLine(argc, argv);
-            return 0;
+            return processCommandLine(argc, argv);
         }
 
         // No command-line arguments, run in interactive mode